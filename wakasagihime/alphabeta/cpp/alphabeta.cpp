@@ -2,91 +2,360 @@
 #define ALPHABETA_CPP
 
 #include "../h/alphabeta.h"
+#include <thread>
+#include <vector>
 
-// Global time check
-std::chrono::time_point<std::chrono::steady_clock> ab_start_time;
 const int AB_TIME_LIMIT_MS = 4000;
-bool time_out = false;
+const int AB_MAX_DEPTH = 50;
+// every line of the search must fit in Position's undo ring: a capture takes one of the 32 pieces
+static_assert(AB_MAX_DEPTH + 31 <= MAX_HISTORY, "the undo ring is shorter than the deepest search line");
+const int AB_INF = 2e9;
+const int ASPIRATION_DELTA = 25;    // half width of the first root window, about a cannon's worth
+const int ASPIRATION_MIN_DEPTH = 4; // shallower iterations are too unstable to predict
+const int QS_DELTA_MARGIN = 30;     // pos_score's distance terms can move this much on one capture
+
+// move ordering: TT move, captures (MVV-LVA), killers, then quiet moves by history, flips last
+const int TT_MOVE_SCORE = 1 << 30;
+const int CAPTURE_SCORE = 1 << 28;
+const int KILLER_SCORE  = 1 << 27;  // history scores stay below this
+const int FLIP_SCORE    = -1;
+
+// kept from one search to the next for their history tables
+static std::vector<SearchContext> search_contexts;
+
+bool is_capture(const Position &pos, Move m){
+    return m.type() == Moving && pos.peek_piece_at(m.to()).type != NO_PIECE;
+}
+
+void score_moves(const SearchContext &ctx, const Position &pos, MoveList<> &moves, Move tt_move, int scores[]){
+    const Move *killers = ctx.killers[std::min(ctx.ply, AB_MAX_PLY - 1)];
+    for(int i = 0; i < moves.size(); i++){
+        Move m = moves.begin()[i];
+        Piece p = pos.peek_piece_at(m.from());
+        if(m == tt_move)
+            scores[i] = TT_MOVE_SCORE;
+        else if(m.type() == Flipping)
+            scores[i] = FLIP_SCORE;
+        else if(is_capture(pos, m))
+            // most valuable victim first, least valuable attacker among equal victims
+            scores[i] = CAPTURE_SCORE + PieceValue[pos.peek_piece_at(m.to()).type] * 1024 - PieceValue[p.type];
+        else if(m == killers[0])
+            scores[i] = KILLER_SCORE + 1;
+        else if(m == killers[1])
+            scores[i] = KILLER_SCORE;
+        else
+            scores[i] = ctx.history[p.side][p.type][m.from()][m.to()];
+    }
+}
+
+// brings the best scored move among i ~ end to i
+// the first moves usually cut off, so this beats sorting the whole list
+static void pick_move(MoveList<> &moves, int scores[], int i){
+    int best = i;
+    for(int j = i + 1; j < moves.size(); j++){
+        if(scores[j] > scores[best])
+            best = j;
+    }
+    std::swap(moves.begin()[i], moves.begin()[best]);
+    std::swap(scores[i], scores[best]);
+}
+
+// a quiet move caused a beta cutoff
+static void update_quiet_stats(SearchContext &ctx, const Position &pos, Move m, int depth){
+    Move *killers = ctx.killers[std::min(ctx.ply, AB_MAX_PLY - 1)];
+    if(killers[0] != m){
+        killers[1] = killers[0];
+        killers[0] = m;
+    }
+
+    Piece p = pos.peek_piece_at(m.from());
+    int &h = ctx.history[p.side][p.type][m.from()][m.to()];
+    h = std::min(h + depth * depth, KILLER_SCORE - 1);
+}
+
+// keeps some of the last search's history, halved so the new position takes over quickly
+static void age_history(SearchContext &ctx){
+    for(auto &color : ctx.history)
+        for(auto &piece : color)
+            for(auto &from : piece)
+                for(int &h : from)
+                    h /= 2;
+}
 
 bool is_terminal(Position &pos){
-    return pos.winner() != NO_COLOR;
+    return pos.game_state() != NO_COLOR;
 }
 
-void log_alphabeta(int depth){
-    std::ofstream fout("./log.log", std::ios::app); // append mode
-    if (!fout.is_open()) {
-        std::cerr << "Failed to open log file\n";
-        return;
+// counts a node, sets ctx.time_out once the clock or the node budget runs out, or when asked to stop
+static bool out_of_budget(SearchContext &ctx){
+    ++ctx.nodes;
+    // a node budget replaces the clock, the search is then repeatable
+    if (ctx.node_limit && ctx.nodes > ctx.node_limit){
+        ctx.time_out = true;
+        return true;
     }
+    // Check time and the stop flag every 256 nodes for more frequent timeout checks
+    if ((ctx.nodes & 255) == 0){
+        bool expired = false;
+        if (!ctx.node_limit){
+            auto now = std::chrono::steady_clock::now();
+            expired = std::chrono::duration_cast<std::chrono::milliseconds>(now - ctx.start_time).count() > AB_TIME_LIMIT_MS;
+        }
+        if (expired || ctx.stop->load(std::memory_order_relaxed)){
+            ctx.time_out = true;
+            return true;
+        }
+    }
+    return ctx.time_out;
+}
 
-    fout << "Alpha-Beta search used:\n";
-    fout << "Time used (ms): " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - ab_start_time).count() << "\n";
-    fout << "depth used: " << depth << "\n";
-    fout << "------------------------\n";
+// wins and losses count plies from the root, so the same win scores the same
+// whichever iteration, thread or search finds it: sooner is better
+static int terminal_score(Position &pos, int ply){
+    int diff = pos_score(pos, pos.due_up());
+    if(pos.game_state() == pos.due_up())
+        return AB_WIN_SCORE - ply + diff; 
+    else if(pos.game_state() == Mystery)
+        return diff; // Draw
+    else
+        return -(AB_WIN_SCORE - ply) + diff;
+}
 
-    fout.close();
+// the TT keeps win and loss scores as plies from the stored node, not from the root
+static int score_to_tt(int score, int ply){
+    if(score > FORCE_WIN_THRESHOLD) return score + ply;
+    if(score < -FORCE_WIN_THRESHOLD) return score - ply;
+    return score;
 }
 
-int F3(Position &pos, int alpha, int beta, int depth){
-    // Check time every 256 nodes for more frequent timeout checks
-    static int node_count = 0;
-    if ((++node_count & 255) == 0){
-        auto now = std::chrono::steady_clock::now();
-        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - ab_start_time).count() > AB_TIME_LIMIT_MS){
-            time_out = true;
-            return 0;
+static int score_from_tt(int score, int ply){
+    if(score > FORCE_WIN_THRESHOLD) return score - ply;
+    if(score < -FORCE_WIN_THRESHOLD) return score + ply;
+    return score;
+}
+
+// captures only, from the horizon on, so that leaves are never scored in the middle of an exchange
+int quiescence(SearchContext &ctx, Position &pos, int alpha, int beta){
+    if(out_of_budget(ctx)) return 0;
+    if(is_terminal(pos)) return terminal_score(pos, ctx.ply);
+
+    // stand pat: the side to move may always decline the captures
+    const Color us = pos.due_up();
+    int mx = pos_score(pos, us);
+    if(mx >= beta)
+        return mx;
+
+    // taking the last piece wins outright, so no capture is too small then
+    const bool last_piece = pos.count(Color(us ^ 1)) == 1;
+
+    MoveList<Captures> moves(pos);
+    Move captures[MAX_MOVES];
+    int scores[MAX_MOVES];
+    int n = 0;
+    for(Move m : moves){
+        int gain = PieceValue[pos.peek_piece_at(m.to()).type];
+        // delta pruning: even winning the victim for free can't lift the score up to alpha
+        if(!last_piece && mx + gain + QS_DELTA_MARGIN <= alpha)
+            continue;
+        captures[n] = m;
+        scores[n++] = gain * 1024 - PieceValue[pos.peek_piece_at(m.from()).type];
+    }
+
+    for(int i = 0; i < n; i++){
+        // MVV-LVA, picked one at a time like in F3
+        int best = i;
+        for(int j = i + 1; j < n; j++){
+            if(scores[j] > scores[best])
+                best = j;
         }
+        std::swap(captures[i], captures[best]);
+        std::swap(scores[i], scores[best]);
+
+        ctx.ply++;
+        pos.do_move(captures[i]);
+        int t = -quiescence(ctx, pos, -beta, -std::max(alpha, mx));
+        pos.undo_move();
+        ctx.ply--;
+
+        if (ctx.time_out) return 0;
+
+        if(t > mx)
+            mx = t;
+        if(mx >= beta)
+            break;
     }
-    if(time_out) return 0;
+    return mx;
+}
+
+int F3(SearchContext &ctx, Position &pos, int alpha, int beta, int depth){
+    if(out_of_budget(ctx)) return 0;
 
     // Depth limit check
-    if(is_terminal(pos)){
-        int diff = pos_score(pos, pos.due_up());
-        // FIX: Add depth bonus. Higher depth value = shallower in tree (closer to root) = faster win.
-        // Assuming depth counts DOWN from Max to 0.
-        if(pos.winner() == pos.due_up())
-            return AB_WIN_SCORE + depth + diff; 
-        else if(pos.winner() == Mystery)
-            return diff; // Draw
-        else
-            return -(AB_WIN_SCORE + depth) + diff;
-    }
+    if(is_terminal(pos))
+        return terminal_score(pos, ctx.ply);
 
     // Depth Cutoff
-    if(depth == 0) {
-        return pos_score(pos, pos.due_up());
+    if(depth == 0)
+        return quiescence(ctx, pos, alpha, beta);
+
+    // Transposition table cutoff
+    TTData tte;
+    Move tt_move = Move(0);
+    ctx.tt_probes++;
+    if(TT.probe(pos.key(), tte)){
+        ctx.tt_hits++;
+        tt_move = tte.move;
+        if(tte.depth >= depth){
+            int tt_score = score_from_tt(tte.score, ctx.ply);
+            if(tte.bound == BOUND_EXACT
+            || (tte.bound == BOUND_LOWER && tt_score >= beta)
+            || (tte.bound == BOUND_UPPER && tt_score <= alpha))
+                return tt_score;
+        }
     }
 
     MoveList<> moves(pos);
+    int scores[MAX_MOVES];
+    score_moves(ctx, pos, moves, tt_move, scores);
 
     int mx = -2e9;
+    Move best = Move(0);
     bool has_safe_move = false;
 
     for(int i = 0; i < moves.size(); i++){
-        Position copy(pos);
-        copy.do_move(moves[i]);
-        
-        int t = -F3(copy, -beta, -std::max(alpha, mx), depth - 1);
+        pick_move(moves, scores, i);
+        const int a = std::max(alpha, mx);
+        ctx.ply++;
+        pos.do_move(moves[i]);
+        int t;
+        if(i == 0)
+            t = -F3(ctx, pos, -beta, -a, depth - 1);
+        else{
+            // PVS: prove the move is no better than the best so far with a null window,
+            // search it again with the full window only if that fails
+            t = -F3(ctx, pos, -a - 1, -a, depth - 1);
+            if(t > a && t < beta && !ctx.time_out)
+                t = -F3(ctx, pos, -beta, -a, depth - 1);
+        }
+        pos.undo_move();
+        ctx.ply--;
         
-        if (time_out) return 0;
+        if (ctx.time_out) return 0;
 
         if(t > mx){
             mx = t;
+            best = moves[i];
             has_safe_move = true;
         }
-        if(mx >= beta)
+        if(mx >= beta){
+            if(!is_capture(pos, best) && best.type() == Moving)
+                update_quiet_stats(ctx, pos, best, depth);
+            TT.store(pos.key(), score_to_tt(mx, ctx.ply), depth, BOUND_LOWER, best);
             return mx;
+        }
     }
     
     // Stalemate check
-    if (!has_safe_move) return -(AB_WIN_SCORE + depth); 
+    if (!has_safe_move) return -(AB_WIN_SCORE - ctx.ply); 
 
+    TT.store(pos.key(), score_to_tt(mx, ctx.ply), depth, mx > alpha ? BOUND_EXACT : BOUND_UPPER, best);
     return mx;
 }
 
-Move alphabeta_search(Position &pos, const std::unordered_map<uint64_t, std::pair<int, Move>> &tt, const int game_round){
-    ab_start_time = std::chrono::steady_clock::now();
-    time_out = false;
+// one PVS pass over the root moves within (alpha, beta), in the order given
+// returns the best score, fail-soft, best_move gets its move
+static int search_root(SearchContext &ctx, MoveList<> &moves, int alpha, int beta, int depth,
+                       bool has_tt_move, Move tt_move, Move &best_move){
+    Position &pos = ctx.pos;
+    int mx = -AB_INF;
+    bool first = true;
+
+    // Search root children manually to track best_move
+    for(int i = 0; i < moves.size(); i++){
+        if(has_tt_move && moves[i] == tt_move) continue;// skip TT move
+
+        const int a = std::max(alpha, mx);
+        ctx.ply++;
+        pos.do_move(moves[i]);
+        // Call F3 with depth - 1
+        int t;
+        if(first)
+            t = -F3(ctx, pos, -beta, -a, depth - 1);
+        else{
+            t = -F3(ctx, pos, -a - 1, -a, depth - 1);
+            if(t > a && t < beta && !ctx.time_out)
+                t = -F3(ctx, pos, -beta, -a, depth - 1);
+        }
+        pos.undo_move();
+        ctx.ply--;
+        first = false;
+
+        if (ctx.time_out) break; // Break inner loop
+
+        if(t > mx){
+            mx = t;
+            best_move = moves[i];
+        }
+        if(mx >= beta)
+            break;
+    }
+    return mx;
+}
+
+// iterative deepening on one thread
+// helpers (odd ids) start one ply deeper so that the threads spread over two depths
+// and fill the shared TT for each other, Lazy SMP style
+static void iterative_deepening(SearchContext &ctx, bool has_tt_move, Move tt_move){
+    MoveList<> moves(ctx.pos);
+
+    for (int depth = 1 + (ctx.id & 1); depth <= AB_MAX_DEPTH; depth++){
+        // the last iteration's best move goes first
+        Move *prev = std::find(moves.begin(), moves.end(), ctx.best_move);
+        if(prev != moves.end())
+            std::rotate(moves.begin(), prev, prev + 1);
+
+        // aspiration window around the last score, widened until the score falls inside
+        int delta = ASPIRATION_DELTA;
+        int alpha = -AB_INF, beta = AB_INF;
+        if(ctx.completed_depth >= ASPIRATION_MIN_DEPTH && std::abs(ctx.best_score) < FORCE_WIN_THRESHOLD){
+            alpha = ctx.best_score - delta;
+            beta = ctx.best_score + delta;
+        }
+
+        int mx;
+        Move best_move_this_iter = moves[0];
+        while(true){
+            mx = search_root(ctx, moves, alpha, beta, depth, has_tt_move, tt_move, best_move_this_iter);
+            if(ctx.time_out)
+                break;
+
+            delta *= 4;
+            if(mx <= alpha && alpha > -AB_INF)
+                alpha = (delta > AB_WIN_SCORE) ? -AB_INF : std::max(alpha - delta, -AB_INF);
+            else if(mx >= beta && beta < AB_INF)
+                beta = (delta > AB_WIN_SCORE) ? AB_INF : std::min(beta + delta, AB_INF);
+            else
+                break;
+        }
+
+        if (ctx.time_out){
+            // If we timed out during Depth K, the results are incomplete/garbage.
+            // We MUST discard Depth K and return the result from Depth K-1.
+            break; 
+        }
+        ctx.completed_depth = depth;
+        ctx.best_move = best_move_this_iter;
+        ctx.best_score = mx;
+        // Optimization: If we found a forced mate, stop early
+        if(mx > FORCE_WIN_THRESHOLD)
+            break;
+        if(ctx.stop->load(std::memory_order_relaxed))
+            break;
+    }
+}
+
+Move alphabeta_search(Position &pos, const std::unordered_map<uint64_t, std::pair<int, Move>> &tt, const int game_round, int threads, uint64_t node_limit, MoveStats *stats){
+    TT.new_search();
 
     MoveList<> moves(pos);
     if(moves.size() == 0) {
@@ -94,11 +363,8 @@ Move alphabeta_search(Position &pos, const std::unordered_map<uint64_t, std::pai
         return Move();
     }
 
-    int best_move = 0;
-    int best_move_this_iter = 0;
-
     // Check transposition table for previously found best move
-    uint64_t pos_hash = compute_zobrist_hash(pos);
+    uint64_t pos_hash = pos.key();
     auto it = tt.find(pos_hash);
     bool has_tt_move = false;
     Move tt_move = moves[0];
@@ -107,48 +373,50 @@ Move alphabeta_search(Position &pos, const std::unordered_map<uint64_t, std::pai
         tt_move = it->second.second;
     }
 
-    
-    // 3. Iterative Deepening Loop
-    // Start at depth 1, increase until time runs out
-    for (int depth = 1; depth <= 50; depth++){
-        
-        int mx = -2e9;
-        int alpha = -2e9;
-        int beta = 2e9;
-
-        // Search root children manually to track best_move
-        for(int i = 0; i < moves.size(); i++){
-            if(has_tt_move && moves[i] == tt_move) continue;// skip TT move
-
-            Position copy(pos);
-            copy.do_move(moves[i]);
-            
-            // Call F3 with depth - 1
-            int t = -F3(copy, -beta, -std::max(alpha, mx), depth - 1);
+    std::atomic<bool> stop(false);
+    std::vector<SearchContext> &ctx = search_contexts;
+    ctx.resize(std::max(1, threads));
+    for(int i = 0; i < (int)ctx.size(); i++){
+        ctx[i].id = i;
+        ctx[i].pos = pos;
+        ctx[i].start_time = std::chrono::steady_clock::now();
+        ctx[i].stop = &stop;
+        ctx[i].time_out = false;
+        ctx[i].nodes = ctx[i].tt_probes = ctx[i].tt_hits = 0;
+        ctx[i].node_limit = node_limit;
+        ctx[i].completed_depth = 0;
+        ctx[i].best_move = moves[0];
+        ctx[i].best_score = 0;
+        ctx[i].ply = 0;
+        std::fill(&ctx[i].killers[0][0], &ctx[i].killers[0][0] + AB_MAX_PLY * 2, Move(0));
+        age_history(ctx[i]);
+    }
 
-            if (time_out) break; // Break inner loop
+    std::vector<std::thread> helpers;
+    for(int i = 1; i < (int)ctx.size(); i++)
+        helpers.emplace_back(iterative_deepening, std::ref(ctx[i]), has_tt_move, tt_move);
+    iterative_deepening(ctx[0], has_tt_move, tt_move);
+    stop = true;
+    for(std::thread &t : helpers)
+        t.join();
 
-            if(t > mx){
-                mx = t;
-                best_move_this_iter = i;
-            }
-        }
+    // the deepest finished iteration wins, the main thread on ties
+    const SearchContext *best = &ctx[0];
+    for(const SearchContext &c : ctx){
+        if(c.completed_depth > best->completed_depth)
+            best = &c;
+    }
 
-        if (time_out){
-            // If we timed out during Depth K, the results are incomplete/garbage.
-            // We MUST discard Depth K and return the result from Depth K-1.
-            break; 
-        }
-        else{
-            best_move = best_move_this_iter;
-            // Optimization: If we found a forced mate, stop early
-            if(mx > FORCE_WIN_THRESHOLD)
-                break;
+    if(stats){
+        stats->ab_depth = best->completed_depth;
+        for(const SearchContext &c : ctx){
+            stats->nodes += c.nodes;
+            stats->tt_probes += c.tt_probes;
+            stats->tt_hits += c.tt_hits;
         }
     }
 
     /*
-    log_alphabeta(depth - 1);
     // if the position has been seen before and the position is good, try to play the different move to avoid repetition
     uint64_t pos_hash = compute_zobrist_hash(pos);
     auto it = tt.find(pos_hash);
@@ -164,22 +432,12 @@ Move alphabeta_search(Position &pos, const std::unordered_map<uint64_t, std::pai
     }
     */
 
-    return moves[best_move];
+    return best->best_move;
 }
 
 int pos_score(Position &pos, const Color cur_color){
-    int score = 0;
     Color opp_color = Color(cur_color ^ 1);
-    
-    for(Square sq = SQ_A1; sq < SQUARE_NB; sq = Square(sq + 1)){
-        Piece p = pos.peek_piece_at(sq);
-        if(p.side == cur_color){
-            score += Piece_Value[p.type];
-        }
-        else if(p.side == opp_color){
-            score -= Piece_Value[p.type];
-        }
-    }
+    int score = pos.material(cur_color) - pos.material(opp_color);
 
     Board my_board = pos.pieces(cur_color);
     Board opp_board = pos.pieces(opp_color);
@@ -0,0 +1,103 @@
+#ifndef TT_CPP
+#define TT_CPP
+
+#include "../h/tt.h"
+#include <cassert>
+
+TranspositionTable TT;
+
+static inline uint16_t key_check(uint64_t key){
+    return key >> 48;
+}
+
+static inline uint64_t pack(uint16_t check, Move move, int score, int depth, Bound bound, uint8_t age){
+    assert(score >= INT16_MIN && score <= INT16_MAX);
+    assert(depth >= 0 && depth < 256);
+    return (uint64_t)check
+         | (uint64_t)(uint16_t)move << 16
+         | (uint64_t)(uint16_t)(int16_t)score << 32
+         | (uint64_t)depth << 48
+         | (uint64_t)bound << 56
+         | (uint64_t)age << 58;
+}
+
+static inline uint8_t entry_depth(uint64_t e){ return (e >> 48) & 0xFF; }
+static inline uint8_t entry_age(uint64_t e){ return e >> 58; }
+
+// a shallower result for the same position may still replace a deeper one by this many plies
+static constexpr int REPLACE_DEPTH_MARGIN = 2;
+
+void TranspositionTable::resize(size_t mb){
+    size_t count = 1;
+    while(count * 2 * sizeof(Bucket) <= mb * 1024 * 1024)
+        count *= 2;
+
+    table.reset(new Bucket[count]);
+    bucketCount = count;
+    clear();
+}
+
+void TranspositionTable::clear(){
+    for(size_t i = 0; i < bucketCount; i++)
+        for(auto &e : table[i].entry)
+            e.store(0, std::memory_order_relaxed);
+    age = 0;
+}
+
+bool TranspositionTable::probe(uint64_t key, TTData &data) const{
+    if(bucketCount == 0)
+        return false;
+
+    const uint16_t check = key_check(key);
+    for(const auto &slot : bucket(key).entry){
+        uint64_t e = slot.load(std::memory_order_relaxed);
+        if(e == 0 || (uint16_t)e != check)
+            continue;
+
+        data.move = Move((uint16_t)(e >> 16));
+        data.score = (int16_t)(e >> 32);
+        data.depth = entry_depth(e);
+        data.bound = Bound((e >> 56) & 3);
+        return true;
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, int score, int depth, Bound bound, Move move){
+    if(bucketCount == 0)
+        return;
+
+    const uint16_t check = key_check(key);
+    Bucket &b = bucket(key);
+
+    // same position: overwrite in place if the new result is exact, about as deep or the old one is
+    // from an earlier search, else only refresh the move; keep the old move if we don't have one
+    // otherwise: replace the shallowest entry, counting each search of age as 8 plies
+    std::atomic<uint64_t> *victim = &b.entry[0];
+    int victim_value = 1 << 30;
+    for(auto &slot : b.entry){
+        uint64_t e = slot.load(std::memory_order_relaxed);
+        if(e != 0 && (uint16_t)e == check){
+            if(move == Move(0))
+                move = Move((uint16_t)(e >> 16));
+            if(bound != BOUND_EXACT && depth < entry_depth(e) - REPLACE_DEPTH_MARGIN && entry_age(e) == age){
+                const uint64_t keep = ~(0xFFFFULL << 16);
+                slot.store((e & keep) | (uint64_t)(uint16_t)move << 16, std::memory_order_relaxed);
+                return;
+            }
+            victim = &slot;
+            break;
+        }
+
+        int value = (e == 0) ? -(1 << 30)
+                             : entry_depth(e) - 8 * ((AGE_NB + age - entry_age(e)) % AGE_NB);
+        if(value < victim_value){
+            victim_value = value;
+            victim = &slot;
+        }
+    }
+
+    victim->store(pack(check, move, score, depth, bound, age), std::memory_order_relaxed);
+}
+
+#endif // TT_CPP
@@ -7,24 +7,43 @@
 #include <fstream>
 #include <chrono>
 #include <unordered_map>
+#include <atomic>
 #include "../../utils/h/zobrist.h"
+#include "../../utils/h/stats.h"
+#include "tt.h"
+
+const int AB_MAX_PLY = 64;
+
+// Everything one search thread owns. Threads only share the TT and the stop flag.
+struct SearchContext {
+    int id = 0;                                         // 0 is the main thread
+    Position pos;                                       // private copy of the root
+    std::chrono::steady_clock::time_point start_time;
+    std::atomic<bool> *stop = nullptr;                  // raised by the main thread when it is done
+    bool time_out = false;
+    uint64_t nodes = 0;
+    uint64_t tt_probes = 0, tt_hits = 0;
+    uint64_t node_limit = 0;                            // stop after this many nodes instead of on time, 0 for none
+
+    int completed_depth = 0;
+    Move best_move = Move(0);
+    int best_score = 0;
+
+    // move ordering
+    int ply = 0;                                        // distance from the root
+    Move killers[AB_MAX_PLY][2] = {};                   // quiet moves that caused a cutoff at this ply
+    int history[SIDE_NB][MOVABLE_PIECE_TYPE_NB][SQUARE_NB][SQUARE_NB] = {}; // [color][piece][from][to]
+};
 
 bool is_terminal(Position &pos);
-int F3(Position &pos, int alpha, int beta, int depth);
-Move alphabeta_search(Position &pos, const std::unordered_map<uint64_t, std::pair<int, Move>> &tt, const int game_round);
-bool move_compare(const Position &pos, const Move &a, const Move &b);
+int quiescence(SearchContext &ctx, Position &pos, int alpha, int beta);
+int F3(SearchContext &ctx, Position &pos, int alpha, int beta, int depth);
+Move alphabeta_search(Position &pos, const std::unordered_map<uint64_t, std::pair<int, Move>> &tt, const int game_round, int threads = 1, uint64_t node_limit = 0, MoveStats *stats = nullptr);
+void score_moves(const SearchContext &ctx, const Position &pos, MoveList<> &moves, Move tt_move, int scores[]);
 int pos_score(Position &pos, const Color cur_color);
 
-const int Piece_Value[] = {
-    810, // General
-    270, // Advisor
-    90,  // Elephant
-    18,  // Chariot
-    6,   // Horse
-    18,  // Cannon
-    1    // Soldier
-};
 const int AB_WIN_SCORE = 20000;
 const int FORCE_WIN_THRESHOLD = AB_WIN_SCORE / 2;
+const int AB_TT_SIZE_MB = 64;
 
 #endif // ALPHABETA_H
\ No newline at end of file
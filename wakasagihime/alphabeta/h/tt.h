@@ -0,0 +1,53 @@
+#ifndef TT_H
+#define TT_H
+
+#include "../../lib/types.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+enum Bound : uint8_t { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT };
+
+struct TTData {
+    Move move;
+    int score;
+    int depth;
+    Bound bound;
+};
+
+// Each entry is packed into a single 64-bit word so that probes and stores from
+// several threads never see a torn entry, no locking needed:
+// Bits  0 ~ 15: key check (upper 16 bits of the key)
+// Bits 16 ~ 31: best move
+// Bits 32 ~ 47: score
+// Bits 48 ~ 55: depth
+// Bits 56 ~ 57: bound
+// Bits 58 ~ 63: age
+class TranspositionTable {
+    static constexpr int BUCKET_SIZE = 8; // 8 entries = one cache line
+    static constexpr int AGE_NB = 64;
+
+    struct alignas(64) Bucket {
+        std::atomic<uint64_t> entry[BUCKET_SIZE];
+    };
+
+    std::unique_ptr<Bucket[]> table;
+    size_t bucketCount = 0; // always a power of two
+    uint8_t age = 0;
+
+    Bucket &bucket(uint64_t key) const { return table[key & (bucketCount - 1)]; }
+
+public:
+    // size is rounded down to a power of two number of buckets
+    void resize(size_t mb);
+    void clear();
+    // call once per root search, older entries become preferred victims
+    void new_search() { age = (age + 1) % AGE_NB; }
+
+    bool probe(uint64_t key, TTData &data) const;
+    void store(uint64_t key, int score, int depth, Bound bound, Move move);
+};
+
+extern TranspositionTable TT;
+
+#endif // TT_H
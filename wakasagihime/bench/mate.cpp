@@ -0,0 +1,85 @@
+// Forced wins through the transposition table
+// A forced win must keep its score however warm the TT is: entries left by other depths,
+// other threads and earlier searches must not change how soon the win is reported.
+// Each position is searched at every depth from an empty TT, then again over a TT warmed
+// by all of those searches and by a full multi-threaded alphabeta_search.
+//
+// usage: mate [fen...]    defaults: the built-in positions below
+
+#include "../alphabeta/h/alphabeta.h"
+#include "../utils/h/init.h"
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+static const std::vector<std::string> DEFAULT_FENS = {
+    "8/8/8/Rn5K b",     // take the last piece
+    "n1R5/2N5/8/7K b",  // the last piece is cornered
+    "np6/2R5/1N6/7K b", // a soldier has to go first
+};
+
+const int MIN_DEPTH = 1;
+const int MAX_DEPTH = 9;
+
+static std::atomic<bool> stop(false);
+
+// one fixed depth root search, the score from the side to move
+static int search(const Position &root, int depth){
+    std::unique_ptr<SearchContext> ctx(new SearchContext);
+    ctx->pos = root;
+    ctx->start_time = std::chrono::steady_clock::now();
+    ctx->stop = &stop;
+    ctx->node_limit = UINT64_MAX; // no clock, the search always finishes
+    return F3(*ctx, ctx->pos, -2e9, 2e9, depth);
+}
+
+int main(int argc, char *argv[]){
+    init_tables();
+    TT.resize(AB_TT_SIZE_MB);
+
+    std::vector<std::string> fens(argv + 1, argv + argc);
+    if(fens.empty())
+        fens = DEFAULT_FENS;
+
+    int failures = 0;
+    for(const std::string &fen : fens){
+        Position pos(fen);
+
+        TT.clear();
+        int cold[MAX_DEPTH + 1];
+        for(int d = MIN_DEPTH; d <= MAX_DEPTH; d++){
+            TT.new_search();
+            cold[d] = search(pos, d);
+        }
+        const int win = cold[MAX_DEPTH];
+        printf("%-24s win score %d\n", fen.c_str(), win);
+        if(win <= FORCE_WIN_THRESHOLD){
+            printf("FAIL %s: no forced win found\n", fen.c_str());
+            failures++;
+            continue;
+        }
+
+        // warm: every depth again, deepest first, then after a whole threaded search
+        std::unordered_map<uint64_t, std::pair<int, Move>> game_tt;
+        for(int pass = 0; pass < 2; pass++){
+            for(int d = MAX_DEPTH; d >= MIN_DEPTH; d--){
+                TT.new_search();
+                int warm = search(pos, d);
+                if(cold[d] > FORCE_WIN_THRESHOLD && warm != cold[d]){
+                    printf("FAIL %s: depth %d scores %d with a warm TT, %d cold\n", fen.c_str(), d, warm, cold[d]);
+                    failures++;
+                }
+            }
+            Position copy(pos);
+            alphabeta_search(copy, game_tt, 1, 4, 200000);
+        }
+    }
+
+    if(failures){
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("forced wins keep their score with a warm TT\n");
+    return 0;
+}
@@ -0,0 +1,214 @@
+// Perft
+// Counts the leaves of the move tree to a fixed depth, for move generation speed and correctness.
+// Flips are chance nodes whose outcome do_move() draws at random, so they are counted
+// as leaves and never searched: the counts stay the same from run to run.
+// The checked pass still plays and takes back every flip, without recursing into it.
+//
+// usage: perft [depth] [fen...]    defaults: depth 5, the built-in positions below
+
+#include "../lib/chess.h"
+#include "../lib/movegen.h"
+#include "../utils/h/init.h"
+#include "../utils/h/zobrist.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static const std::vector<std::string> DEFAULT_FENS = {
+    "rPRePePa/KAPPCEAN/ppnNnRca/EcprCkpp r",    // opening, full bright
+    "PccPrnaK/NpE1a1rR/C1peCPA1/pPEpkPRe r",    // middle game
+    "kr6/1n6/3E4/4A2N r",                       // endgame
+    "???????\?/???????\?/???????\?/???????? r", // all face down, flips only ("\?" keeps "??/" from being a trigraph)
+    "??c?rnaK/Np?1a1rR/C1pe?PA1/pP?pkPRe b",    // mixed
+};
+
+// bulk counted, for speed
+static uint64_t perft(Position &pos, int depth){
+    MoveList<> moves(pos);
+    if(depth == 1)
+        return moves.size();
+
+    uint64_t nodes = 0;
+    for(const Move &m : moves){
+        if(m.type() == Flipping){
+            nodes++;
+            continue;
+        }
+        pos.do_move(m);
+        nodes += perft(pos, depth - 1);
+        pos.undo_move();
+    }
+    return nodes;
+}
+
+static int failures = 0;
+
+static void fail(Position &pos, const char *what){
+    if(failures++ < 10)
+        fprintf(stderr, "FAIL %s: %s\n", what, pos.toFEN().c_str());
+}
+
+// board[], the bitboards, the counters and the key must all describe the same position
+static void check_invariants(Position &pos){
+    Board all = 0, faceup = 0, color[SIDE_NB] = {0, 0};
+    Board type[PIECE_TYPE_NB] = {0};
+    int material[SIDE_NB] = {0, 0};
+    for(Square sq = SQ_A1; sq < SQUARE_NB; sq += 1){
+        Piece p = pos.peek_piece_at(sq);
+        if(p.type == NO_PIECE)
+            continue;
+        all |= square_bb(sq);
+        type[p.type] |= square_bb(sq);
+        if(p.side < SIDE_NB){
+            faceup |= square_bb(sq);
+            color[p.side] |= square_bb(sq);
+            material[p.side] += PieceValue[p.type];
+        }
+    }
+
+    if(pos.pieces() != all || pos.pieces(FACE_UP) != faceup)
+        fail(pos, "byTypeBB[ALL_PIECES / FACE_UP]");
+    for(PieceType pt = General; pt < ALL_PIECES; pt += 1){
+        if(pt != FACE_UP && pos.pieces(pt) != type[pt])
+            fail(pos, "byTypeBB");
+    }
+    for(Color c : {Black, Red}){
+        if(pos.pieces(c) != color[c])
+            fail(pos, "byColorBB");
+        if(pos.material(c) != material[c])
+            fail(pos, "material");
+        for(PieceType pt = General; pt <= Soldier; pt += 1){
+            if(pos.count(c, pt) != __builtin_popcount(color[c] & type[pt]))
+                fail(pos, "pieceCount");
+        }
+    }
+    if(pos.key() != compute_zobrist_hash(pos))
+        fail(pos, "key");
+}
+
+struct Snapshot {
+    Piece board[SQUARE_NB];
+    Color side;
+    int fifty;
+    uint64_t key;
+    int hidden[SIDE_NB][SHOWN_PIECE_TYPE_NB];
+    int hidden_total;
+
+    explicit Snapshot(const Position &pos)
+      : side(pos.due_up()), fifty(pos.fifty_moves()), key(pos.key()), hidden_total(pos.hidden_count()){
+        for(Square sq = SQ_A1; sq < SQUARE_NB; sq += 1)
+            board[sq] = pos.peek_piece_at(sq);
+        for(Color c : {Black, Red}){
+            for(PieceType pt = General; pt < SHOWN_PIECE_TYPE_NB; pt += 1)
+                hidden[c][pt] = pos.hidden_count(c, pt);
+        }
+    }
+
+    bool operator==(const Snapshot &o) const{
+        for(Square sq = SQ_A1; sq < SQUARE_NB; sq += 1){
+            if(board[sq].side != o.board[sq].side || board[sq].type != o.board[sq].type)
+                return false;
+        }
+        for(Color c : {Black, Red}){
+            for(PieceType pt = General; pt < SHOWN_PIECE_TYPE_NB; pt += 1){
+                if(hidden[c][pt] != o.hidden[c][pt])
+                    return false;
+            }
+        }
+        return side == o.side && fifty == o.fifty && key == o.key && hidden_total == o.hidden_total;
+    }
+};
+
+// every move played and taken back, leaves and flips included, with the invariants checked at each node
+static uint64_t perft_checked(Position &pos, int depth){
+    check_invariants(pos);
+    if(depth == 0)
+        return 1;
+
+    // captures, quiet moves and flips split the full list
+    MoveList<Captures> captures(pos);
+    MoveList<Quiets> quiets(pos);
+    MoveList<Flipping> flips(pos);
+    // attackers_to() must find exactly the capturers the generator found
+    Board capturers[SQUARE_NB] = {};
+    for(const Move &m : captures){
+        if(pos.peek_piece_at(m.to()).type == NO_PIECE)
+            fail(pos, "MoveList<Captures>");
+        capturers[m.to()] |= square_bb(m.from());
+    }
+    for(Square sq = SQ_A1; sq < SQUARE_NB; sq += 1){
+        PieceType victim = pos.peek_piece_at(sq).type;
+        Board expected = 0;
+        if(pos.peek_piece_at(sq).side == ~pos.due_up()){
+            for(Square from : BoardView(pos.attackers_to(sq, pos.due_up()))){
+                if(pos.peek_piece_at(from).type > victim)
+                    expected |= square_bb(from);
+            }
+        }
+        if(expected != capturers[sq])
+            fail(pos, "attackers_to");
+    }
+    for(const Move &m : quiets){
+        if(pos.peek_piece_at(m.to()).type != NO_PIECE)
+            fail(pos, "MoveList<Quiets>");
+    }
+
+    uint64_t nodes = 0;
+    MoveList<> moves(pos);
+    if(captures.size() + quiets.size() + flips.size() != moves.size())
+        fail(pos, "MoveList<Captures> + <Quiets> + <Flipping>");
+    for(const Move &m : moves){
+        Snapshot before(pos);
+        pos.do_move(m);
+        if(m.type() == Flipping){
+            // a chance node: one random outcome is checked, none is searched
+            check_invariants(pos);
+            nodes++;
+        } else
+            nodes += perft_checked(pos, depth - 1);
+        pos.undo_move();
+        if(!(Snapshot(pos) == before))
+            fail(pos, "undo_move");
+    }
+    return nodes;
+}
+
+int main(int argc, char *argv[]){
+    init_tables();
+
+    int depth = argc > 1 ? std::max(1, atoi(argv[1])) : 5;
+    std::vector<std::string> fens(argv + std::min(argc, 2), argv + argc);
+    if(fens.empty())
+        fens = DEFAULT_FENS;
+
+    uint64_t total_nodes = 0;
+    double total_seconds = 0;
+    for(const std::string &fen : fens){
+        Position pos(fen);
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t nodes = perft(pos, depth);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t checked = perft_checked(pos, depth);
+        if(checked != nodes){
+            fprintf(stderr, "FAIL count: %llu checked vs %llu bulk\n", (unsigned long long)checked, (unsigned long long)nodes);
+            failures++;
+        }
+
+        printf("%-40s depth %d  nodes %12llu  %8.3f s  %10.0f nodes/s\n",
+               fen.c_str(), depth, (unsigned long long)nodes, seconds, nodes / std::max(seconds, 1e-9));
+        total_nodes += nodes;
+        total_seconds += seconds;
+    }
+    printf("total nodes %llu  %.3f s  %.0f nodes/s\n", (unsigned long long)total_nodes, total_seconds, total_nodes / std::max(total_seconds, 1e-9));
+
+    if(failures){
+        printf("%d invariant failures\n", failures);
+        return 1;
+    }
+    printf("make/unmake and bitboard invariants ok\n");
+    return 0;
+}
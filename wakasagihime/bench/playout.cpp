@@ -0,0 +1,136 @@
+// Playout benchmark
+// Times the pieces of an MCTS playout over a corpus of positions from each game phase
+// and prints one JSON object with min/median/p99 nanoseconds per operation.
+// The rng is seeded so that every run plays the same games (pool_round aside, its threads race).
+//
+// usage: playout [samples]    default: 30 samples per benchmark
+
+#include "../lib/chess.h"
+#include "../lib/movegen.h"
+#include "../lib/helper.h"
+#include "../mcts/h/simulation.h"
+#include "../mcts/h/pool.h"
+#include "../utils/h/init.h"
+#include "../utils/h/zobrist.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct Phase {
+    const char *name;
+    std::vector<std::string> fens;
+};
+
+static const std::vector<Phase> CORPUS = {
+    // mostly face down, so flips dominate ("\?" keeps "??/" from being a trigraph)
+    { "opening", {
+        "???????\?/???????\?/???????\?/???????? r", // nothing flipped yet
+        "???????\?/??p????\?/?????C?\?/???????? r", // two flips in
+        "???????\?/?P???a?\?/??????N1/?k?????? b",   // a few flips and a capture
+    }},
+    { "middle", {
+        "1c1Pr1aK/Np3r2/C2eC1A1/p1E1k1R1 r",
+        "2c1r2K/1p1n2R1/C3eP2/p3k1Rp b",
+        "4r1aK/Np6/2Ce4/1pE1k1R1 r",
+    }},
+    { "endgame", {
+        "kr6/1n6/3E4/4A2N r",
+        "ka6/8/3E4/4A2N r",
+        "k7/8/8/6AE r",
+    }},
+};
+
+const int POOL_THREADS = 4;
+
+static volatile unsigned long long sink; // keeps the results alive
+
+struct Result {
+    std::string name, phase;
+    std::vector<double> ns; // per operation, one entry per sample
+};
+
+// fn runs one operation on a position and returns something to sink
+static Result measure(const std::string &name, const Phase &phase, int samples, int reps,
+                      const std::function<long long(Position &)> &fn){
+    std::vector<Position> positions;
+    for(const std::string &fen : phase.fens)
+        positions.emplace_back(fen);
+
+    Result r{name, phase.name, {}};
+    unsigned long long s = 0; // wraps, only there to be kept
+    for(int i = 0; i < samples; i++){
+        auto start = std::chrono::steady_clock::now();
+        for(int k = 0; k < reps; k++)
+            for(Position &pos : positions)
+                s += fn(pos);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        r.ns.push_back(ns / (reps * positions.size()));
+    }
+    sink = s;
+    return r;
+}
+
+static double percentile(std::vector<double> v, double p){
+    std::sort(v.begin(), v.end());
+    size_t i = std::min(v.size() - 1, (size_t)(p * (v.size() - 1) + 0.5));
+    return v[i];
+}
+
+int main(int argc, char *argv[]){
+    init_tables();
+    seed_rng(1);
+
+    int samples = argc > 1 ? std::max(1, atoi(argv[1])) : 30;
+    static long long played_moves[total_type][SQUARE_NB][SQUARE_NB];
+    long long iter = 0;
+    PlayoutPool pool(POOL_THREADS);
+    std::vector<Playout> batch;
+
+    std::vector<Result> results;
+    for(const Phase &phase : CORPUS){
+        results.push_back(measure("pos_simulation", phase, samples, 20, [&](Position &pos){
+            return pos_simulation(pos, played_moves, pos.due_up(), ++iter, 0);
+        }));
+        // one per-action round of leaf parallel MCTS: pool.size() playouts, their AMAF stamps applied
+        results.push_back(measure("pool_round", phase, samples, 20, [&](Position &pos){
+            batch.assign(pool.size(), Playout{pos, 0, 0, 0, PlayedList{}});
+            for(Playout &p : batch)
+                p.iter = ++iter;
+            pool.run(batch, pos.due_up());
+            long long s = 0;
+            for(const Playout &p : batch){
+                p.played.apply(played_moves, p.iter);
+                s += p.result;
+            }
+            return s;
+        }));
+        results.push_back(measure("simulate", phase, samples, 20, [](Position &pos){
+            return pos.simulate(strategy_random);
+        }));
+        results.push_back(measure("movelist", phase, samples, 20000, [](Position &pos){
+            MoveList<> moves(pos);
+            return moves.size();
+        }));
+        results.push_back(measure("winner", phase, samples, 20000, [](Position &pos){
+            return pos.winner();
+        }));
+        results.push_back(measure("zobrist", phase, samples, 20000, [](Position &pos){
+            return compute_zobrist_hash(pos);
+        }));
+    }
+
+    printf("{\"samples\": %d, \"unit\": \"ns/op\", \"results\": [\n", samples);
+    for(size_t i = 0; i < results.size(); i++){
+        const Result &r = results[i];
+        double median = percentile(r.ns, 0.5);
+        printf("  {\"name\": \"%s\", \"phase\": \"%s\", \"min\": %.1f, \"median\": %.1f, \"p99\": %.1f, \"ops_per_sec\": %.0f}%s\n",
+               r.name.c_str(), r.phase.c_str(), percentile(r.ns, 0), median, percentile(r.ns, 0.99),
+               1e9 / median, i + 1 < results.size() ? "," : "");
+    }
+    printf("]}\n");
+    return 0;
+}
@@ -7,7 +7,27 @@ std::ostream &info  = std::cout;
 std::ostream &error = std::cerr;
 std::ostream &debug = std::cerr;
 
-pcg32 rng(pcg_extras::seed_seq_from<std::random_device>{});
+static uint64_t random_seed()
+{
+    std::random_device rd;
+    return (uint64_t)rd() << 32 | rd();
+}
+
+static std::atomic<uint64_t> masterSeed(random_seed());
+static std::atomic<uint64_t> nextStream(1 << 16); // ids below are left for explicit streams
+
+thread_local pcg32 rng(masterSeed.load(), nextStream++);
+
+void seed_rng(uint64_t seed)
+{
+    masterSeed = seed;
+    seed_rng_stream(0);
+}
+
+void seed_rng_stream(uint64_t stream)
+{
+    rng.seed(masterSeed.load(), stream);
+}
 
 std::vector<std::string> split_fen(const std::string &fen)
 {
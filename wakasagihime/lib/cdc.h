@@ -5,6 +5,8 @@
 #define CDC_H
 
 #include "pcg-cpp-0.98/include/pcg_random.hpp"
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <random>
 #include <regex>
@@ -20,9 +22,26 @@ extern std::ostream &debug; // This is also stderr
 
 /*
  * Pseudo-random number generator provided by PCG.
+ * Each thread owns its own generator. All of them are seeded from one master
+ * seed, each on its own stream, so threads never share a sequence and a run
+ * can be replayed by fixing the master seed.
+ * Threads that never call seed_rng_stream() are given an unused stream.
  * @global
  */
-extern pcg32 rng;
+extern thread_local pcg32 rng;
+
+/*
+ * Sets the master seed and reseeds the calling thread on stream 0.
+ * Call it before starting other threads.
+ * @param seed The master seed
+ */
+void seed_rng(uint64_t seed);
+
+/*
+ * Reseeds the calling thread from the master seed.
+ * @param stream Stream id, threads that must not share numbers need different ones
+ */
+void seed_rng_stream(uint64_t stream);
 
 /*
  * Vector syntax sugar so we can do `vec << stuff, more_stuff`
@@ -6,6 +6,7 @@
 #include "cdc.h"
 #include "marisa.h"
 #include "types.h"
+#include <algorithm>
 #include <cstddef>
 #include <ostream>
 #include <string>
@@ -50,6 +51,12 @@ uint8_t SquareDistance[SQUARE_NB][SQUARE_NB];
 
 Board PseudoAttacks[SQUARE_NB];
 
+namespace Zobrist {
+uint64_t psq[NO_COLOR][PIECE_TYPE_NB][SQUARE_NB];
+uint64_t side;
+uint64_t fifty[FIFTY_MOVE_NB];
+}
+
 std::ostream &operator<<(std::ostream &os, const Square &sq)
 {
     os << (char)('A' + file_of(sq)) << (1 + rank_of(sq));
@@ -88,24 +95,6 @@ std::string pretty(Board &b)
     return s;
 }
 
-template<PieceType pt>
-inline Board attacks_bb(Square sq, Board occupied)
-{
-    switch (pt) {
-        case Cannon:
-            return cannonMagics[sq].attacks_bb(occupied);
-        default:
-            return PseudoAttacks[sq];
-    }
-}
-template Board attacks_bb<General>(Square sq, Board occupied);
-template Board attacks_bb<Advisor>(Square sq, Board occupied);
-template Board attacks_bb<Elephant>(Square sq, Board occupied);
-template Board attacks_bb<Chariot>(Square sq, Board occupied);
-template Board attacks_bb<Horse>(Square sq, Board occupied);
-template Board attacks_bb<Cannon>(Square sq, Board occupied);
-template Board attacks_bb<Soldier>(Square sq, Board occupied);
-
 // Variable version
 Board attacks_bb(PieceType pt, Square sq, Board occupied)
 {
@@ -147,7 +136,7 @@ std::istream &operator>>(std::istream &is, Move &mv)
     if (cmd == "FLIP") {
         Square sq;
         is >> sq;
-        mv = Move(sq, sq);
+        mv = Move::flip(sq);
     } else if (cmd == "MOVE") {
         Square from, to;
         is >> from >> to;
@@ -182,24 +171,107 @@ void Position::clear()
 {
     memset(byTypeBB, 0, sizeof(byTypeBB));
     memset(byColorBB, 0, sizeof(byColorBB));
+    memset(pieceCount, 0, sizeof(pieceCount));
+    memset(materialScore, 0, sizeof(materialScore));
     for (Square sq = SQ_A1; sq < SQUARE_NB; sq += 1) {
         board[sq] = Piece();
     }
 
     info.fiftyMoveCount = 0;
     info.illegal        = NO_COLOR;
-    info.time_remaining = std::pair(0.0, 0.0);
+    info.time_remaining[Red]   = 0.0;
+    info.time_remaining[Black] = 0.0;
+
+    hashKey = (sideToMove == Black) ? Zobrist::side : 0;
+    stateKnown = false;
+}
+
+void Position::set_fifty_moves(int n)
+{
+    hashKey ^= Zobrist::fifty[std::min(info.fiftyMoveCount, FIFTY_MOVE_NB - 1)];
+    hashKey ^= Zobrist::fifty[std::min(n, FIFTY_MOVE_NB - 1)];
+    info.fiftyMoveCount = n;
+    stateKnown = false;
 }
 
 Board Position::subordinates(Color c, PieceType pt) const
 {
+    assert(pt < REAL_PIECE_TYPE_NB);
     Board b = 0;
-    for (PieceType target = General; target < SHOWN_PIECE_TYPE_NB; target += 1) {
-        if (pt > target) {
-            b |= pieces(~c, target);
+    for (unsigned m = CaptureMask[pt]; m; m &= m - 1) {
+        b |= byTypeBB[__builtin_ctz(m)];
+    }
+    return b & byColorBB[~c];
+}
+
+void Position::subordinates(Color c, Board targets[MOVABLE_PIECE_TYPE_NB]) const
+{
+    Board enemies[SHOWN_PIECE_TYPE_NB];
+    for (PieceType pt = General; pt < SHOWN_PIECE_TYPE_NB; pt += 1) {
+        enemies[pt] = byTypeBB[pt] & byColorBB[~c];
+    }
+    for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+        Board b = 0;
+        for (unsigned m = CaptureMask[pt]; m; m &= m - 1) {
+            b |= enemies[__builtin_ctz(m)];
+        }
+        targets[pt] = b;
+    }
+}
+
+Board Position::attackers_to(Square sq, Color c, Board occupied) const
+{
+    assert(c == Red || c == Black);
+    Board steppers = PseudoAttacks[sq] & ~byTypeBB[Cannon] & ~byTypeBB[Duck];
+    Board cannons  = cannonMagics[sq].attacks_bb(occupied) & byTypeBB[Cannon];
+    return (steppers | cannons) & byColorBB[c] & occupied;
+}
+
+// Recapturers are tried cheapest first
+constexpr PieceType SeeOrder[MOVABLE_PIECE_TYPE_NB] = { Soldier, Horse,    Chariot, Cannon,
+                                                        Elephant, Advisor, General };
+
+int Position::see(Move mv) const
+{
+    assert(mv.type() == Moving);
+    const Square to = mv.to();
+    PieceType onTarget = board[mv.from()].type;
+    Color side         = ~board[mv.from()].side;
+    Board occupied     = (byTypeBB[ALL_PIECES] ^ mv.from()) | to;
+
+    // gain[d]: what the side making the d-th capture wins if the exchange stopped there
+    int gain[SQUARE_NB + 1];
+    int d   = 0;
+    gain[0] = board[to].type == NO_PIECE ? 0 : PieceValue[board[to].type];
+
+    for (;;) {
+        d += 1;
+        gain[d] = PieceValue[onTarget] - gain[d - 1]; // if _side_ takes the piece on the target
+        // neither side can do better by going on
+        if (std::max(-gain[d - 1], gain[d]) < 0) {
+            break;
+        }
+
+        Board attackers = attackers_to(to, side, occupied);
+        Board from      = 0;
+        for (PieceType pt : SeeOrder) {
+            if ((attackers & byTypeBB[pt]) && pt > onTarget) {
+                from     = attackers & byTypeBB[pt];
+                onTarget = pt;
+                break;
+            }
+        }
+        if (!from) {
+            break;
         }
+        occupied ^= from & -from; // one of them is enough
+        side = ~side;
     }
-    return b;
+
+    while (--d > 0) {
+        gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+    }
+    return gain[0];
 }
 
 void Position::place_piece_at(const Piece &p, Square sq)
@@ -209,6 +281,8 @@ void Position::place_piece_at(const Piece &p, Square sq)
     }
 
     board[sq] = p;
+    hashKey ^= Zobrist::psq[p.side][p.type][sq];
+    stateKnown = false;
 
     byTypeBB[p.type] |= sq;
     byTypeBB[ALL_PIECES] |= sq;
@@ -217,6 +291,11 @@ void Position::place_piece_at(const Piece &p, Square sq)
         // is red or black (face up)
         byTypeBB[FACE_UP] |= sq;
         byColorBB[p.side] |= sq;
+
+        pieceCount[p.side][p.type] += 1;
+        pieceCount[p.side][FACE_UP] += 1;
+        pieceCount[p.side][ALL_PIECES] += 1;
+        materialScore[p.side] += PieceValue[p.type];
     }
 }
 
@@ -224,6 +303,8 @@ Piece Position::remove_piece_at(Square sq)
 {
     Piece p   = board[sq];
     board[sq] = Piece();
+    hashKey ^= Zobrist::psq[p.side][p.type][sq];
+    stateKnown = false;
 
     byTypeBB[p.type] ^= sq;
     byTypeBB[ALL_PIECES] ^= sq;
@@ -231,6 +312,11 @@ Piece Position::remove_piece_at(Square sq)
     if (p.side < SIDE_NB) {
         byTypeBB[FACE_UP] ^= sq;
         byColorBB[p.side] ^= sq;
+
+        pieceCount[p.side][p.type] -= 1;
+        pieceCount[p.side][FACE_UP] -= 1;
+        pieceCount[p.side][ALL_PIECES] -= 1;
+        materialScore[p.side] -= PieceValue[p.type];
     }
 
     return p;
@@ -251,37 +337,58 @@ bool Position::flip_piece_at(Square sq)
     if (peek_piece_at(sq).side != Mystery) {
         return false;
     }
-    Piece new_piece =
-        pieceCollection.empty() ? random_faceup_piece() : sample_remove(pieceCollection);
+    Piece new_piece = collectionSize == 0 ? random_faceup_piece() : sample_collection();
 
     place_piece_at(new_piece, sq);
     return true;
 }
 
+Piece Position::sample_collection()
+{
+    int n = rng(collectionSize);
+    for (Color c : { Black, Red }) {
+        for (PieceType pt = General; pt < SHOWN_PIECE_TYPE_NB; pt += 1) {
+            if (n < collection[c][pt]) {
+                collection[c][pt] -= 1;
+                collectionSize -= 1;
+                return Piece(c, pt);
+            }
+            n -= collection[c][pt];
+        }
+    }
+    assert(false);
+    return Piece();
+}
+
+void Position::return_collection(const Piece &p)
+{
+    assert(p.side < SIDE_NB && p.type < SHOWN_PIECE_TYPE_NB);
+    collection[p.side][p.type] += 1;
+    collectionSize += 1;
+}
+
 void Position::add_collection(Piece *set, size_t n)
 {
     if (set == nullptr) {
         // use default piece set
         for (Color s : { Color::Red, Color::Black }) {
             // clang-format off
-            pieceCollection
-                << Piece(s, General)
-                << Piece(s, Advisor)  << Piece(s, Advisor)
-                << Piece(s, Elephant) << Piece(s, Elephant)
-                << Piece(s, Chariot)  << Piece(s, Chariot)
-                << Piece(s, Horse)    << Piece(s, Horse)
-                << Piece(s, Cannon)   << Piece(s, Cannon)
-                << Piece(s, Soldier)  << Piece(s, Soldier)
-                << Piece(s, Soldier)  << Piece(s, Soldier)
-                << Piece(s, Soldier);
+            collection[s][General]  += 1;
+            collection[s][Advisor]  += 2;
+            collection[s][Elephant] += 2;
+            collection[s][Chariot]  += 2;
+            collection[s][Horse]    += 2;
+            collection[s][Cannon]   += 2;
+            collection[s][Soldier]  += 5;
             // clang-format on
+            collectionSize += 16;
         }
         return;
     }
 
     // Use provided n pieces
     for (int i = 0; i < n; i += 1) {
-        pieceCollection << set[i];
+        return_collection(set[i]);
     }
 }
 
@@ -322,18 +429,21 @@ void Position::readFEN(std::string fen)
                 }
                 break;
             case 4:
-                sideToMove = (token.compare("b") == 0) ? Black : Red;
+                if (((token.compare("b") == 0) ? Black : Red) != sideToMove) {
+                    sideToMove = ~sideToMove;
+                    hashKey ^= Zobrist::side;
+                }
                 break;
             case 5:
                 try {
-                    info.time_remaining.first = std::stod(token);
+                    info.time_remaining[Red] = std::stod(token);
                 } catch (...) {
                     error << "Failed to parse first time!\n";
                 }
                 break;
             case 6:
                 try {
-                    info.time_remaining.second = std::stod(token);
+                    info.time_remaining[Black] = std::stod(token);
                 } catch (...) {
                     error << "Failed to parse second time!\n";
                 }
@@ -390,14 +500,11 @@ bool Position::do_move(const Move &mv)
             bool flipped_black = (pieces(Black) & mv.from());
             if (!first_flip || !flipped_black) {
                 sideToMove = ~sideToMove;
+                hashKey ^= Zobrist::side;
             }
 
             // record flip
-            history.push(PastMove {
-                .mv      = mv,
-                .p       = peek_piece_at(sq),
-                .fmc_old = info.fiftyMoveCount,
-            });
+            history.push(PastMove(mv, peek_piece_at(sq), info.fiftyMoveCount));
         }
         return success;
     }
@@ -413,12 +520,14 @@ bool Position::do_move(const Move &mv)
     if (src.side != sideToMove) {
         // Wrong side
         info.illegal = sideToMove;
+        stateKnown   = false;
         return false;
     }
 
     if (static_cast<int>(src.type) > static_cast<int>(Soldier)) {
         // Moving the wrong pieces
         info.illegal = sideToMove;
+        stateKnown   = false;
         return false;
     }
 
@@ -426,20 +535,18 @@ bool Position::do_move(const Move &mv)
     if (!(valid_dest & to) || !(src.type > dst.type)) {
         // Not a valid move destination
         info.illegal = sideToMove;
+        stateKnown   = false;
         return false;
     }
 
     move_piece(from, to);
 
     // record move
-    history.push(PastMove {
-        .mv      = mv,
-        .p       = dst,
-        .fmc_old = info.fiftyMoveCount,
-    });
+    history.push(PastMove(mv, dst, info.fiftyMoveCount));
 
     sideToMove = ~sideToMove;
-    info.fiftyMoveCount = (dst.type == NO_PIECE) ? info.fiftyMoveCount + 1 : 0;
+    hashKey ^= Zobrist::side;
+    set_fifty_moves((dst.type == NO_PIECE) ? info.fiftyMoveCount + 1 : 0);
     return true;
 }
 
@@ -450,24 +557,30 @@ bool Position::undo_move()
     }
 
     PastMove pmv = history.top();
+    const Piece p = pmv.piece();
     // restore board state
     switch (pmv.mv.type()) {
         case Moving:
         move_piece(pmv.mv.to(), pmv.mv.from()); // move back
-        info.fiftyMoveCount = pmv.fmc_old;      // restore count
-        if (pmv.p.type != NO_PIECE) {           // restore captured piece
-            place_piece_at(pmv.p, pmv.mv.to());
+        set_fifty_moves(pmv.fmc_old);           // restore count
+        if (p.type != NO_PIECE) {               // restore captured piece
+            place_piece_at(p, pmv.mv.to());
         }
         break;
 
         case Flipping:
-        if (pmv.p.type == NO_PIECE) {
+        if (p.type == NO_PIECE) {
             error << "undo_move - [Error] Flipped has type NO" << std::endl;
             return false;
         }
         place_piece_at(Piece(Mystery, Hidden), pmv.mv.from());
-        info.fiftyMoveCount = pmv.fmc_old;
-        pieceCollection << pmv.p;
+        set_fifty_moves(pmv.fmc_old);
+        return_collection(p);
+        if (__builtin_popcount(pieces(Hidden)) == 32 && p.side == Black) {
+            // the first flip revealed Black, so do_move() kept the side to move
+            history.pop();
+            return true;
+        }
         break;
 
         default:
@@ -477,6 +590,7 @@ bool Position::undo_move()
 
     history.pop();
     sideToMove = ~sideToMove;
+    hashKey ^= Zobrist::side;
     return true;
 }
 
@@ -487,9 +601,9 @@ double Position::time_left(Color color) const
     }
     switch (color) {
         case Red:
-            return info.time_remaining.first;
+            return info.time_remaining[Red];
         case Black:
-            return info.time_remaining.second;
+            return info.time_remaining[Black];
         default:
             return 0.0;
     }
@@ -506,16 +620,14 @@ Color Position::winner(WinCon *wc) const
     }
 
     // No legal moves
-    MoveList<All, Black> moves_b(*this);
-    if (moves_b.size() == 0) {
+    if (!has_legal_move(Black)) {
         if (wc) {
             *wc = count(Black) > 0 ? WinCon::DeadPosition : WinCon::Elimination;
         }
         return Red;
     }
 
-    MoveList<All, Red> moves_r(*this);
-    if (moves_r.size() == 0) {
+    if (!has_legal_move(Red)) {
         if (wc) {
             *wc = count(Red) > 0 ? WinCon::DeadPosition : WinCon::Elimination;
         }
@@ -536,16 +648,54 @@ Color Position::winner(WinCon *wc) const
     return NO_COLOR;
 }
 
+Color Position::game_state() const
+{
+    if (!stateKnown) {
+        state      = winner();
+        stateKnown = true;
+    }
+    return state;
+}
+
+bool Position::has_legal_move(Color c) const
+{
+    assert(c == Red || c == Black);
+
+    // Anyone can flip
+    if (byTypeBB[Hidden]) {
+        return true;
+    }
+
+    Board occupied = byTypeBB[ALL_PIECES];
+    for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+        Board bb = pieces(c, pt);
+        if (bb == 0) {
+            continue;
+        }
+        Board target = subordinates(c, pt) | ~occupied;
+        if (pt == Cannon) {
+            for (Square sq : BoardView(bb)) {
+                if (attacks_bb<Cannon>(sq, occupied) & target) {
+                    return true;
+                }
+            }
+        } else if (adjacent_bb(bb) & target) {
+            return true;
+        }
+    }
+    return false;
+}
+
 int Position::simulate(Move (*strategy)(MoveList<> &moves))
 {
     Position copy(*this);
-    while (copy.winner() == NO_COLOR) {
+    while (copy.game_state() == NO_COLOR) {
         MoveList moves(copy);
         copy.do_move(strategy(moves));
     }
-    if (copy.winner() == due_up()) {
+    if (copy.game_state() == due_up()) {
         return 1;
-    } else if (copy.winner() == Mystery) {
+    } else if (copy.game_state() == Mystery) {
         return 0;
     }
     return -1;
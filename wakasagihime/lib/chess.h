@@ -10,12 +10,12 @@
 #include "types.h"
 
 #include <array>
-#include <stack>
 #include <cassert>
 #include <csignal>
 #include <cstdint>
 #include <cstring>
 #include <optional>
+#include <type_traits>
 
 // -~ Colors ~-
 
@@ -102,11 +102,11 @@ constexpr Square &operator+=(Square &sq, int i)
 // -~ Pieces ~-
 
 /*
- * Compares PieceTypes and tells you if a can capture b.
- * @param   a   Capturer piece type
- * @param   b   Target piece type
+ * The capture rules, spelled out: can a capture b?
+ * @internal
+ * @note    Use operator> below, which looks the answer up in a table built from this.
  */
-inline bool operator>(PieceType a, PieceType b)
+constexpr bool capture_rule(PieceType a, PieceType b)
 {
     if (b == Duck) {
         return false; // quack
@@ -132,6 +132,72 @@ constexpr PieceType &operator+=(PieceType &sq, int i)
     return sq;
 }
 
+/*
+ * Capture rules as bitmasks: bit _b_ of CaptureTable[a] is set if _a_ can capture _b_.
+ * 64 bits wide so that every PieceType value fits, including NO_PIECE (moving to an
+ * empty square), and a whole row can be tested against a set of types at once.
+ */
+constexpr std::array<uint64_t, PIECE_TYPE_NB> make_capture_table()
+{
+    std::array<uint64_t, PIECE_TYPE_NB> table {};
+    for (PieceType a = General; a < PIECE_TYPE_NB; a += 1) {
+        for (int b = 0; b < 64; b += 1) {
+            if (capture_rule(a, PieceType(b))) {
+                table[a] |= uint64_t(1) << b;
+            }
+        }
+    }
+    return table;
+}
+inline constexpr std::array<uint64_t, PIECE_TYPE_NB> CaptureTable = make_capture_table();
+
+/*
+ * Compares PieceTypes and tells you if a can capture b.
+ * @param   a   Capturer piece type
+ * @param   b   Target piece type, NO_PIECE for an empty square
+ */
+constexpr bool operator>(PieceType a, PieceType b)
+{
+    assert(a < PIECE_TYPE_NB && b < 64);
+    return (CaptureTable[a] >> b) & 1;
+}
+
+/*
+ * Capture rules as bitmasks over the shown types only:
+ * bit _b_ of CaptureMask[a] is set if _a_ can capture _b_.
+ * Covers capturers General to Hidden (Duck and Hidden rows are empty)
+ * and targets General to Duck.
+ */
+constexpr std::array<uint8_t, REAL_PIECE_TYPE_NB> make_capture_masks()
+{
+    std::array<uint8_t, REAL_PIECE_TYPE_NB> masks {};
+    for (PieceType a = General; a < REAL_PIECE_TYPE_NB; a += 1) {
+        masks[a] = CaptureTable[a] & ((1 << SHOWN_PIECE_TYPE_NB) - 1);
+    }
+    return masks;
+}
+inline constexpr std::array<uint8_t, REAL_PIECE_TYPE_NB> CaptureMask = make_capture_masks();
+
+// The table must agree with the rules everywhere
+constexpr bool capture_table_ok()
+{
+    for (PieceType a = General; a < PIECE_TYPE_NB; a += 1) {
+        for (int b = 0; b < 64; b += 1) {
+            if ((a > PieceType(b)) != capture_rule(a, PieceType(b))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+static_assert(capture_table_ok());
+static_assert(Soldier > General && !(General > Soldier), "soldiers topple generals");
+static_assert(General > Advisor && !(Advisor > General), "ranks are ordered");
+static_assert(Cannon > General && Cannon > Cannon && !(Cannon > Duck), "cannons hit any rank");
+static_assert(!(General > Hidden) && !(Cannon > Hidden), "face-down pieces are safe");
+static_assert(Soldier > NO_PIECE && General > NO_PIECE, "anyone can move to an empty square");
+static_assert(CaptureMask[Horse] == ((1 << Horse) | (1 << Cannon) | (1 << Soldier)));
+
 inline Piece random_faceup_piece()
 {
     return Piece(Color(rng(SIDE_NB)), PieceType(rng(MOVABLE_PIECE_TYPE_NB)));
@@ -201,16 +267,37 @@ constexpr Board &operator^=(Board &b, Square s) { return b ^= square_bb(s); } //
  */
 constexpr Board operator|(Square a, Square b) { return square_bb(a) | b; }
 
+/*
+ * All squares orthogonally adjacent to any square of a bitboard.
+ * Same as OR-ing PseudoAttacks over the set squares.
+ * @param   b   The bitboard
+ */
+constexpr Board adjacent_bb(Board b)
+{
+    return (b << 8) | (b >> 8) | ((b & ~FileHBB) << 1) | ((b & ~FileABB) >> 1);
+}
+
 /*
  * Attack bitboard (all valid move destinations) for any real face-up piece type
  * @param   pt          Piece type
  * @param   sq          Origin square
  * @param   occupied    All present pieces on the board
+ * @note    The template version is defined in marisa.h so that it inlines, include that to use it.
  */
 template<PieceType pt>
-Board attacks_bb(Square sq, Board occupied);
+inline Board attacks_bb(Square sq, Board occupied);
 Board attacks_bb(PieceType pt, Square sq, Board occupied);
 
+// -~ Zobrist ~-
+// Random keys XORed into Position::key(), filled in by init_zobrist() (utils/h/zobrist.h)
+constexpr int FIFTY_MOVE_NB = 64; // counts past this are clamped, the game is over long before
+
+namespace Zobrist {
+extern uint64_t psq[NO_COLOR][PIECE_TYPE_NB][SQUARE_NB]; // [side][type][square], Mystery included
+extern uint64_t side;                                      // Black to move
+extern uint64_t fifty[FIFTY_MOVE_NB];                      // fifty[0] is always 0
+}
+
 // -~ Move ~-
 std::ostream &operator<<(std::ostream &os, const Move &mv);
 std::istream &operator>>(std::istream &is, Move &mv);
@@ -222,11 +309,29 @@ class Position {
     Piece board[SQUARE_NB];
     Board byTypeBB[PIECE_TYPE_NB];
     Board byColorBB[SIDE_NB];
+    uint8_t pieceCount[SIDE_NB][PIECE_TYPE_NB]; // face-up pieces, also summed in FACE_UP/ALL_PIECES
+    int materialScore[SIDE_NB];
     // Data
     Color sideToMove;
-    std::vector<Piece> pieceCollection;
+    uint8_t collection[SIDE_NB][SHOWN_PIECE_TYPE_NB]; // face-down pieces left, per kind
+    uint8_t collectionSize;
     StateInfo info;
-    std::stack<PastMove> history;
+    History history;
+    uint64_t hashKey;
+    // winner() cache, dropped whenever the position changes
+    mutable bool stateKnown;
+    mutable Color state;
+
+    /*
+     * Sets the fifty move counter, keeping the hash key in sync.
+     */
+    void set_fifty_moves(int n);
+
+    /*
+     * Draws a random piece from the bag / puts one back in.
+     */
+    Piece sample_collection();
+    void return_collection(const Piece &p);
 
     public:
     /*
@@ -236,6 +341,7 @@ class Position {
       : sideToMove(Red)
     {
         clear();
+        clear_collection();
     }
 
     /*
@@ -243,6 +349,7 @@ class Position {
      * @param   fen The FEN string
      */
     Position(std::string fen)
+      : sideToMove(Red)
     {
         clear();
         readFEN(fen);
@@ -270,7 +377,11 @@ class Position {
     /*
      * Clears the bag for face-down pieces.
      */
-    void clear_collection() { pieceCollection.clear(); }
+    void clear_collection()
+    {
+        memset(collection, 0, sizeof(collection));
+        collectionSize = 0;
+    }
 
     /*
      * Makes a position from a FEN-like string.
@@ -297,11 +408,48 @@ class Position {
      */
     Color winner(WinCon *wc = nullptr) const;
 
+    /*
+     * Same as winner(), but the result is cached until the position changes,
+     * so checking it repeatedly in a playout loop is free.
+     */
+    Color game_state() const;
+
+    /*
+     * Whether a side can make any move at all.
+     * Stops at the first legal move found, without generating a MoveList.
+     *
+     * @param   c   Red or Black
+     */
+    bool has_legal_move(Color c) const;
+
     /*
      * @returns Red/Black   The color to play.
      */
     Color due_up() const { return sideToMove; }
 
+    /*
+     * @returns The number of moves played since the last capture.
+     */
+    int fifty_moves() const { return info.fiftyMoveCount; }
+
+    /*
+     * Zobrist hash of the position, updated incrementally on every change.
+     * Covers the pieces on the board, the side to move and the fifty move counter.
+     *
+     * @returns The 64-bit key
+     * @note    Always 0 if init_zobrist() has not been called.
+     */
+    uint64_t key() const { return hashKey; }
+
+    /*
+     * key() without the fifty move component.
+     * Use this to match positions read from FEN strings, which don't carry the counter.
+     */
+    uint64_t board_key() const
+    {
+        return hashKey ^ Zobrist::fifty[std::min(info.fiftyMoveCount, FIFTY_MOVE_NB - 1)];
+    }
+
     /*
      * Gets the time remaining.
      * Not available for HW1.
@@ -372,12 +520,34 @@ class Position {
     {
         assert(pt < PIECE_TYPE_NB);
         if (c == Red || c == Black) {
-            return __builtin_popcount(byColorBB[c] & byTypeBB[pt]);
+            return pieceCount[c][pt];
         }
         return __builtin_popcount(byTypeBB[pt]);
     }
     inline int count(PieceType pt = ALL_PIECES) const { return count(Mystery, pt); }
 
+    /*
+     * Face-down pieces of a kind still in the bag, drawn from when a piece is flipped.
+     * @param   c   Red or Black
+     * @param   pt  A shown piece type
+     */
+    inline int hidden_count(Color c, PieceType pt) const
+    {
+        assert(c < SIDE_NB && pt < SHOWN_PIECE_TYPE_NB);
+        return collection[c][pt];
+    }
+    inline int hidden_count() const { return collectionSize; }
+
+    /*
+     * Total PieceValue of the face-up pieces of a color, kept up to date on every change.
+     * @param   c   Red or Black
+     */
+    inline int material(Color c) const
+    {
+        assert(c == Red || c == Black);
+        return materialScore[c];
+    }
+
     /*
      * Gets a Board of all pieces that are
      *   - of lower or equal rank to _pt_
@@ -390,6 +560,37 @@ class Position {
      */
     Board subordinates(Color c, PieceType pt) const;
 
+    /*
+     * subordinates() for every movable piece type at once.
+     *
+     * @param   c       Color of the "capturers"
+     * @param   targets Filled with subordinates(c, pt) for pt = General ~ Soldier
+     */
+    void subordinates(Color c, Board targets[MOVABLE_PIECE_TYPE_NB]) const;
+
+    /*
+     * Gets a Board of the face-up pieces of color _c_ that can reach _sq_ in one move:
+     * neighbours for most pieces, cannons jumping over exactly one screen.
+     *
+     * @param   sq          The target square, empty or not
+     * @param   c           Color of the attackers
+     * @param   occupied    Pieces considered on the board. Defaults to all of them.
+     *                      Squares left out of it can neither attack nor screen.
+     * @note    Ranks are ignored, filter with operator> against the piece on _sq_.
+     */
+    Board attackers_to(Square sq, Color c, Board occupied) const;
+    Board attackers_to(Square sq, Color c) const { return attackers_to(sq, c, pieces()); }
+
+    /*
+     * Static exchange evaluation: the material the side to move wins by playing _mv_,
+     * after which both sides keep recapturing on its target square with their least
+     * valuable capable piece, or stop when that no longer pays.
+     *
+     * @param   mv  A moving (not flipping) move of the side to move, a quiet move included
+     * @returns The net PieceValue won, negative if the moved piece is lost for less
+     */
+    int see(Move mv) const;
+
     /*
      * Places a piece at a square. If a piece already exists, it will be replaced.
      * @param   p   The piece to place.
@@ -438,13 +639,16 @@ class Position {
     bool do_move(const Move &mv);
 
     /*
-     * @experimental
      * Undoes the last successful move. This may be called multiple times.
+     * Does not allocate, so searches can do_move()/undo_move() on a single Position
+     * instead of copying it for every child.
      *
      * The following are restored:
      *      - board state
      *      - hidden pieces pool
      *      - 50-move rule count
+     *      - side to move (including the first flip of a Black piece)
+     *      - hash key
      *
      * The following are NOT restored:
      *      - times
@@ -466,6 +670,9 @@ class Position {
     int simulate(Move (*strategy)(MoveList<> &moves));
 };
 
+// Positions are plain data: copying one is a memcpy, no allocation
+static_assert(std::is_trivially_copyable_v<Position>);
+
 std::ostream &operator<<(std::ostream &os, const Position &pos);
 
 #endif
\ No newline at end of file
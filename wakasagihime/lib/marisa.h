@@ -64,6 +64,17 @@ struct Magic {
 extern Board cannonTable[];
 extern Magic cannonMagics[SQUARE_NB];
 
+// Declared in chess.h
+template<PieceType pt>
+inline Board attacks_bb(Square sq, Board occupied)
+{
+    if constexpr (pt == Cannon) {
+        return cannonMagics[sq].attacks_bb(occupied);
+    } else {
+        return PseudoAttacks[sq];
+    }
+}
+
 /*
  * @internal
  * @param   s       The origin square
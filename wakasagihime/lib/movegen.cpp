@@ -4,26 +4,29 @@
 
 #include "movegen.h"
 #include "chess.h"
+#include "marisa.h"
 #include "types.h"
 
-Move *generate_moves(const Color Us, const PieceType pt, const Position &pos, Move *moveList)
+template<Color Us, PieceType pt>
+Move *generate_moves(const Position &pos, Board target, Move *moveList)
 {
-    assert(pt < REAL_PIECE_TYPE_NB && (Us == Red || Us == Black || Us == Mystery));
+    static_assert(pt < REAL_PIECE_TYPE_NB && (Us == Red || Us == Black));
 
-    Board bb = pt == Hidden ? pos.pieces(Hidden) : pos.pieces(Us, pt);
-    if (bb == 0) {
-        return moveList;
-    }
+    if constexpr (pt == Hidden) {
+        // flip, one Move word per face-down piece
+        for (Board bb = pos.pieces(Hidden); bb; bb &= bb - 1) {
+            *moveList++ = Move::flip(Square(__builtin_ctz(bb)));
+        }
+    } else {
+        // move
+        Board bb = pos.pieces(Us, pt);
+        if (bb == 0 || target == 0) {
+            return moveList;
+        }
 
-    Board pieces = pos.pieces();
-    Board target = pos.subordinates(Us, pt) | ~pieces;
-    for (Square from : BoardView(bb)) {
-        if (pt == Hidden) {
-            // flip
-            *moveList++ = Move(from, from);
-        } else {
-            // move
-            Board attacks = attacks_bb(pt, from, pieces) & target;
+        Board pieces = pos.pieces();
+        for (Square from : BoardView(bb)) {
+            Board attacks = attacks_bb<pt>(from, pieces) & target;
             for (Square to : BoardView(attacks)) {
                 *moveList++ = Move(from, to);
             }
@@ -32,52 +35,80 @@ Move *generate_moves(const Color Us, const PieceType pt, const Position &pos, Mo
     return moveList;
 }
 
-template<MoveType Type>
-Move *generate_all(const Color Us, const Position &pos, Move *moveList)
+// One piece type known only at run time
+template<Color Us>
+Move *generate_moves(PieceType pt, const Position &pos, Board target, Move *moveList)
 {
-    assert(Us == Color::Black || Us == Color::Red);
+    switch (pt) {
+        case General:
+            return generate_moves<Us, General>(pos, target, moveList);
+        case Advisor:
+            return generate_moves<Us, Advisor>(pos, target, moveList);
+        case Elephant:
+            return generate_moves<Us, Elephant>(pos, target, moveList);
+        case Chariot:
+            return generate_moves<Us, Chariot>(pos, target, moveList);
+        case Horse:
+            return generate_moves<Us, Horse>(pos, target, moveList);
+        case Cannon:
+            return generate_moves<Us, Cannon>(pos, target, moveList);
+        case Soldier:
+            return generate_moves<Us, Soldier>(pos, target, moveList);
+        default:
+            return moveList;
+    }
+}
 
-    constexpr bool make_moves = (Type & Moving);
-    constexpr bool make_flips = (Type & Flipping);
+template<MoveType Type, Color Us>
+Move *generate_all(const Position &pos, Move *moveList)
+{
+    static_assert(Us == Color::Black || Us == Color::Red);
 
-    if (make_moves) {
-        moveList = generate_moves(Us, General, pos, moveList);
-        moveList = generate_moves(Us, Advisor, pos, moveList);
-        moveList = generate_moves(Us, Elephant, pos, moveList);
-        moveList = generate_moves(Us, Chariot, pos, moveList);
-        moveList = generate_moves(Us, Horse, pos, moveList);
-        moveList = generate_moves(Us, Cannon, pos, moveList);
-        moveList = generate_moves(Us, Soldier, pos, moveList);
+    constexpr bool make_captures = (Type & (Moving | Captures));
+    constexpr bool make_quiets   = (Type & (Moving | Quiets));
+    constexpr bool make_flips    = (Type & Flipping);
+
+    if constexpr (make_captures || make_quiets) {
+        Board targets[MOVABLE_PIECE_TYPE_NB] = {};
+        Board empty = make_quiets ? ~pos.pieces() : 0;
+        if (make_captures) {
+            pos.subordinates(Us, targets);
+        }
+
+        moveList = generate_moves<Us, General>(pos, targets[General] | empty, moveList);
+        moveList = generate_moves<Us, Advisor>(pos, targets[Advisor] | empty, moveList);
+        moveList = generate_moves<Us, Elephant>(pos, targets[Elephant] | empty, moveList);
+        moveList = generate_moves<Us, Chariot>(pos, targets[Chariot] | empty, moveList);
+        moveList = generate_moves<Us, Horse>(pos, targets[Horse] | empty, moveList);
+        moveList = generate_moves<Us, Cannon>(pos, targets[Cannon] | empty, moveList);
+        moveList = generate_moves<Us, Soldier>(pos, targets[Soldier] | empty, moveList);
     }
-    if (make_flips) {
-        moveList = generate_moves(Us, Hidden, pos, moveList);
+    if constexpr (make_flips) {
+        moveList = generate_moves<Us, Hidden>(pos, 0, moveList);
     }
 
     return moveList;
 }
 
-// Explicit template instantiation
-template Move *generate_all<Moving>(Color, const Position &, Move *);
-template Move *generate_all<Flipping>(Color, const Position &, Move *);
-template Move *generate_all<All>(Color, const Position &, Move *);
-
 template<MoveType Type, Color Side>
 Move *generate(const Position &pos, PieceType pieceType, Move *moveList)
 {
     assert(pieceType < SHOWN_PIECE_TYPE_NB || pieceType == ALL_PIECES);
 
+    Color Us = (Side == Mystery) ? pos.due_up() : Side;
     if (pieceType == ALL_PIECES) {
-        if (Side == Mystery) {
-            return generate_all<Type>(pos.due_up(), pos, moveList);
-        } else {
-            return generate_all<Type>(Side, pos, moveList);
-        }
+        return Us == Black ? generate_all<Type, Black>(pos, moveList)
+                           : generate_all<Type, Red>(pos, moveList);
     } else {
-        if (Side == Mystery) {
-            return generate_moves(pos.due_up(), pieceType, pos, moveList);
-        } else {
-            return generate_moves(Side, pieceType, pos, moveList);
+        Board target = 0;
+        if (Type != Quiets) {
+            target |= pos.subordinates(Us, pieceType);
+        }
+        if (Type != Captures) {
+            target |= ~pos.pieces();
         }
+        return Us == Black ? generate_moves<Black>(pieceType, pos, target, moveList)
+                           : generate_moves<Red>(pieceType, pos, target, moveList);
     }
 }
 
@@ -90,4 +121,10 @@ template Move *generate<Moving, Black>(const Position &, PieceType pieceType, Mo
 template Move *generate<Moving, Red>(const Position &, PieceType pieceType, Move *);
 template Move *generate<Flipping, Mystery>(const Position &, PieceType pieceType, Move *);
 template Move *generate<Flipping, Red>(const Position &, PieceType pieceType, Move *);
-template Move *generate<Flipping, Black>(const Position &, PieceType pieceType, Move *);
\ No newline at end of file
+template Move *generate<Flipping, Black>(const Position &, PieceType pieceType, Move *);
+template Move *generate<Captures, Mystery>(const Position &, PieceType pieceType, Move *);
+template Move *generate<Captures, Red>(const Position &, PieceType pieceType, Move *);
+template Move *generate<Captures, Black>(const Position &, PieceType pieceType, Move *);
+template Move *generate<Quiets, Mystery>(const Position &, PieceType pieceType, Move *);
+template Move *generate<Quiets, Red>(const Position &, PieceType pieceType, Move *);
+template Move *generate<Quiets, Black>(const Position &, PieceType pieceType, Move *);
\ No newline at end of file
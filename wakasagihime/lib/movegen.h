@@ -30,18 +30,19 @@ class MoveList {
      *
      * @param   T   Type of moves to generate. Ignored if _pt_ is specified.
      *              Defaults to All.
-     *              Options: {All, Moving, Flipping}
+     *              Options: {All, Moving, Flipping, Captures, Quiets}
+     *              Captures and Quiets are the two halves of Moving.
      * @param   C   Color whose moves to generate.
      *              Defaults to the side to play.
      * @param   pos The position whose moves to generate.
      * @param   pt  Only generate moves for this piece type.
      *              Defaults to ALL_PIECES if not specified.
-     *              _T_ is ignored if specified.
+     *              If specified, _T_ only tells Captures and Quiets apart.
      */
     explicit MoveList(const Position &pos)
       : last(generate<T, C>(pos, ALL_PIECES, moveList))
     {}
-    // If a piece type is specified, MoveType is ignored
+    // If a piece type is specified, MoveType is ignored except for Captures and Quiets
     explicit MoveList(const Position &pos, PieceType pt)
       : last(generate<T, C>(pos, pt, moveList))
     {}
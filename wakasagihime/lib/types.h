@@ -11,7 +11,7 @@
 #include <vector>
 
 // -~ Colors ~-
-enum Color { Black, Red, SIDE_NB, Mystery, NO_COLOR };
+enum Color : uint8_t { Black, Red, SIDE_NB, Mystery, NO_COLOR };
 
 // -~ Squares ~-
 // clang-format off
@@ -43,7 +43,7 @@ enum Direction : int {
 };
 
 // -~ Pieces ~-
-enum PieceType {
+enum PieceType : uint8_t {
     General = 0,
     Advisor,
     Elephant,
@@ -66,6 +66,18 @@ enum PieceType {
     NO_PIECE              = 42
 };
 
+// Material value of each shown piece type
+constexpr int PieceValue[SHOWN_PIECE_TYPE_NB] = {
+    810, // General
+    270, // Advisor
+    90,  // Elephant
+    18,  // Chariot
+    6,   // Horse
+    18,  // Cannon
+    1,   // Soldier
+    0    // Duck
+};
+
 extern const char PIECE2CHAR[SIDE_NB][REAL_PIECE_TYPE_NB];
 extern const std::string PIECE2WIDECHAR[SIDE_NB][REAL_PIECE_TYPE_NB];
 
@@ -171,7 +183,8 @@ struct BoardView {
 //     - b01: move
 //     - b10: flip
 // Bits 12 ~ 15: unused
-enum MoveType { Moving = 1, Flipping = 2, All = 3 };
+// Captures and Quiets split Moving for move generation only, Move::type() never returns them
+enum MoveType { Moving = 1, Flipping = 2, All = 3, Captures = 4, Quiets = 8 };
 class Move {
     private:
     uint16_t raw;
@@ -187,12 +200,17 @@ class Move {
         raw |= (from == to) ? (MoveType::Flipping << 10) : (MoveType::Moving << 10);
     }
 
-    constexpr operator uint16_t() { return raw; }
-    constexpr Move &operator=(const Move &other)
+    /*
+     * A flip of the piece on _sq_, built straight from the bit layout above
+     * without the from == to test of the constructor.
+     */
+    static constexpr Move flip(Square sq)
     {
-        raw = other.raw;
-        return *this;
+        return Move(uint16_t(sq | (sq << 5) | (MoveType::Flipping << 10)));
     }
+
+    constexpr operator uint16_t() { return raw; }
+    constexpr Move &operator=(const Move &other) = default;
     bool operator<(const Move &other) const { return raw < other.raw; }
     bool operator>(const Move &other) const { return raw > other.raw; }
     bool operator<=(const Move &other) const { return raw <= other.raw; }
@@ -207,6 +225,7 @@ class Move {
     Square from() const { return Square(raw & 0x1F); }
     Square to() const { return Square((raw >> 5) & 0x1F); }
 };
+static_assert(uint16_t(Move::flip(SQ_C2)) == uint16_t(Move(SQ_C2, SQ_C2)));
 
 // -~ WinCon ~-
 // Win conditions
@@ -242,15 +261,61 @@ class WinCon {
 struct StateInfo {
     int fiftyMoveCount;
     Color illegal;
-    std::pair<double, double> time_remaining; // RED, BLACK
+    double time_remaining[SIDE_NB]; // indexed by Color
 };
 
 // -~ PastMoves ~-
 // Records moves done, for unwinding
+// Packed into 4 bytes, the piece as side << 4 | type, or NO_PIECE_CODE for no piece
 struct PastMove {
+    static constexpr uint8_t NO_PIECE_CODE = 0xFF;
+
     Move mv;
-    Piece p;        // Either the piece flipped, or the piece captured
-    int fmc_old;    // save the fifty move counter
+    uint8_t packed;     // Either the piece flipped, or the piece captured
+    uint8_t fmc_old;    // save the fifty move counter
+
+    PastMove() = default;
+    PastMove(Move mv, Piece p, int fmc)
+      : mv(mv)
+      , packed(p.type == NO_PIECE ? NO_PIECE_CODE : uint8_t(p.side << 4 | p.type))
+      , fmc_old(static_cast<uint8_t>(fmc))
+    {}
+
+    Piece piece() const
+    {
+        return packed == NO_PIECE_CODE ? Piece() : Piece(Color(packed >> 4), PieceType(packed & 15));
+    }
+};
+static_assert(sizeof(PastMove) == 4, "PastMove should stay packed");
+
+// -~ History ~-
+// A fixed-size stack of PastMoves stored inline, so Positions copy without allocating.
+// Pushing onto a full stack drops the oldest move: only the last MAX_HISTORY moves
+// can be undone. Playouts never undo, the deepest undo is an alpha-beta line:
+// AB_MAX_DEPTH plies then at most 31 quiescence captures (checked in alphabeta.cpp).
+constexpr int MAX_HISTORY = 96;
+
+class History {
+    private:
+    PastMove moves[MAX_HISTORY];
+    uint8_t head  = 0; // slot for the next push
+    uint8_t count = 0;
+
+    public:
+    void push(const PastMove &pm)
+    {
+        moves[head] = pm;
+        head        = (head + 1) % MAX_HISTORY;
+        count += (count < MAX_HISTORY);
+    }
+    void pop()
+    {
+        assert(count > 0);
+        head = (head + MAX_HISTORY - 1) % MAX_HISTORY;
+        count -= 1;
+    }
+    const PastMove &top() const { return moves[(head + MAX_HISTORY - 1) % MAX_HISTORY]; }
+    size_t size() const { return count; }
 };
 
 class Position;
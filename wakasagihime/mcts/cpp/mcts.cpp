@@ -7,34 +7,36 @@
 #include "../../lib/marisa.h"
 #include <cmath>
 #include <limits>
+#include <cassert>
+#include <algorithm>
 
-long double UCB(int id, const std::vector<MCTSNode> &tree){
-    if(tree[id].sqrtN == 0) return inf; 
+double UCB(NodeId id, const MCTSTree &tree){
+    if(tree.sqrtN[id] == 0) return inf; 
     
     // mcts ucb
-    long double mc_score = (tree[id].depth & 1) ? (1 - (tree[id].Mean-MIN_S) / RANGE) : (tree[id].Mean - MIN_S) / RANGE;
+    double mc_score = (tree.depth[id] & 1) ? (1 - (tree.Mean[id]-MIN_S) / RANGE) : (tree.Mean[id] - MIN_S) / RANGE;
     
     // If visited enough, purely exploit
-    if(tree[id].Ntotal >= MAX_VISIT)
+    if(tree.Ntotal[id] >= MAX_VISIT)
         return mc_score;
     // amaf
-    long double amaf_score = 0;
-    if(tree[id].N_AMAF > 0){
-        amaf_score = (tree[id].depth & 1) ? (1 - (tree[id].Mean_AMAF - MIN_S) / RANGE) : (tree[id].Mean_AMAF - MIN_S) / RANGE;
+    double amaf_score = 0;
+    if(tree.N_AMAF[id] > 0){
+        amaf_score = (tree.depth[id] & 1) ? (1 - (tree.Mean_AMAF[id] - MIN_S) / RANGE) : (tree.Mean_AMAF[id] - MIN_S) / RANGE;
     }
 
-    long double alpha = std::min(1.0L, (long double)tree[id].Ntotal / RAVE_EQUIV);
-    long double combined_score = alpha * mc_score + (1.0L - alpha) * amaf_score;
+    double alpha = std::min(1.0, (double)tree.Ntotal[id] / RAVE_EQUIV);
+    double combined_score = alpha * mc_score + (1.0 - alpha) * amaf_score;
 
-    return combined_score + tree[ tree[id].p_id ].CsqrtlogN / tree[id].sqrtN;
+    return combined_score + tree.CsqrtlogN[ tree.p_id[id] ] / tree.sqrtN[id];
 }
 
-int find_best_ucb(int cur_id, const std::vector<MCTSNode> &tree){
-    int maxchild = tree[cur_id].c_id[0];
-    long double maxV = UCB(maxchild, tree);
-    for(int i = 1; i < tree[cur_id].Nchild; i++){
-        int ctemp = tree[cur_id].c_id[i];
-        long double temp = UCB(ctemp, tree);
+NodeId find_best_ucb(NodeId cur_id, const MCTSTree &tree){
+    NodeId maxchild = tree.child(cur_id, 0);
+    double maxV = UCB(maxchild, tree);
+    for(int i = 1; i < tree.Nchild[cur_id]; i++){
+        NodeId ctemp = tree.child(cur_id, i);
+        double temp = UCB(ctemp, tree);
         if(maxV < temp){
             maxV = temp; maxchild = ctemp;
         }
@@ -42,42 +44,53 @@ int find_best_ucb(int cur_id, const std::vector<MCTSNode> &tree){
     return maxchild;
 }
 
-Position find_pv(const Position &pos, int &cur_id, const std::vector<MCTSNode> &tree){
+Position find_pv(const Position &pos, NodeId &cur_id, const MCTSTree &tree){
 
     Position pv_pos(pos);
 
-    while(tree[cur_id].Nchild > 0){ // while not reaching a leaf
-        int next_id = find_best_ucb(cur_id, tree);
-        pv_pos.do_move(tree[next_id].ply);
+    while(tree.Nchild[cur_id] > 0){ // while not reaching a leaf
+        NodeId next_id = find_best_ucb(cur_id, tree);
+        pv_pos.do_move(tree.ply[next_id]);
         cur_id = next_id;
     }
     return pv_pos;
 }
 
-bool expand(const Position &pos, const int cur_id, std::vector<MCTSNode> &tree){
+bool expand(const Position &pos, const NodeId cur_id, MCTSTree &tree){
     MoveList<> moves(pos);
 
     if(moves.size() == 0)
         return false; // no expansion possible
 
-    for(int i = 0; i < moves.size(); i++){
-        tree.push_back(MCTSNode(cur_id, tree[cur_id].depth + 1, moves[i], pos));
-        tree[cur_id].Nchild++;
-        tree[cur_id].c_id[tree[cur_id].Nchild - 1] = tree.size() - 1;
-    }
+    tree.add_children(cur_id, moves.begin(), moves.end(), pos);
     return true;
 }
 
-void update(int id, const int deltaS, const int deltaS2, const int deltaN, std::vector<MCTSNode> &tree){
-    tree[id].Ntotal += deltaN; 
-    tree[id].CsqrtlogN = C * sqrt(log((long double) tree[id].Ntotal));
-    tree[id].sqrtN = sqrt((long double) tree[id].Ntotal);
-    tree[id].sum1 += deltaS; 
-    tree[id].sum2 += deltaS2;
-    tree[id].Mean = (long double) tree[id].sum1 / (long double) tree[id].Ntotal;
-    
-    tree[id].Variance = (long double) tree[id].sum2 / (long double) tree[id].Ntotal -
-                        tree[id].Mean * tree[id].Mean;
+void update(NodeId id, const int deltaS, const int deltaN, MCTSTree &tree){
+    tree.Ntotal[id] += deltaN; 
+    tree.sum1[id] += deltaS; 
+    if(tree.Ntotal[id] == 0){ // a virtual loss was taken back from an unvisited node
+        tree.CsqrtlogN[id] = tree.sqrtN[id] = tree.Mean[id] = 0;
+        return;
+    }
+    tree.CsqrtlogN[id] = C * sqrt(log((double) tree.Ntotal[id]));
+    tree.sqrtN[id] = sqrt((double) tree.Ntotal[id]);
+    tree.Mean[id] = (double) tree.sum1[id] / (double) tree.Ntotal[id];
+}
+
+// the worst score for whoever picks this node, as seen by UCB
+static int virtual_loss_score(NodeId id, const MCTSTree &tree){
+    return (tree.depth[id] & 1) ? (int)(MIN_S + RANGE) : (int)MIN_S;
+}
+
+void add_virtual_loss(NodeId leaf, MCTSTree &tree){
+    for(NodeId id = leaf; id != root_id; id = tree.p_id[id])
+        update(id, virtual_loss_score(id, tree), VIRTUAL_LOSS, tree);
+}
+
+void remove_virtual_loss(NodeId leaf, MCTSTree &tree){
+    for(NodeId id = leaf; id != root_id; id = tree.p_id[id])
+        update(id, -virtual_loss_score(id, tree), -VIRTUAL_LOSS, tree);
 }
 
 bool early_termination_checker(const Position &pos, const std::vector<Square> &pcs1, const std::vector<Square> &pcs2){
@@ -113,56 +126,127 @@ bool early_termination(Position &pos){
             early_termination_checker(pos, black_pcs, red_pcs));
 }
 
-void mcts_simulate(Position &pos, int cur_id, std::vector<MCTSNode> &tree, const Color root_color){
+// mcts_simulate() with the playouts run in batches on pool
+// the initial playouts go out as one batch, the per-action ones in rounds of pool->size(),
+// virtual loss on the children already picked in a round spreads the round over several of them
+static void mcts_simulate_batched(Position &pos, NodeId cur_id, MCTSTree &tree, const Color root_color, PlayoutPool &pool){
     long long played_moves[total_type][SQUARE_NB][SQUARE_NB] = {{{0}}};// [piece_type][from][to]
+    std::vector<Playout> batch;
+    std::vector<NodeId> batch_id;
+
+    auto add = [&](NodeId child_id, long long iter){
+        Playout p{pos, iter, tree.depth[child_id], 0, PlayedList{}};
+        p.pos.do_move(tree.ply[child_id]);
+        batch.push_back(p);
+        batch_id.push_back(child_id);
+    };
+    auto flush = [&]{
+        pool.run(batch, root_color);
+        // in batch order, each backpropagation sees the same stamps as in mcts_simulate()
+        for(size_t k = 0; k < batch.size(); k++){
+            batch[k].played.apply(played_moves, batch[k].iter);
+            backpropagate(batch_id[k], batch[k].result, 1, tree, played_moves);
+        }
+        batch.clear();
+        batch_id.clear();
+    };
 
     long long iter = 1;
-    for(int i = 0; i < tree[cur_id].Nchild; i++){
-        int child_id = tree[cur_id].c_id[i];
+    for(int i = 0; i < tree.Nchild[cur_id]; i++){
+        for(int j = 0; j < INITIAL_SIMULATIONS; j++)
+            add(tree.child(cur_id, i), iter++);
+    }
+    flush();
+
+    for(int done = 0; done < SIMULATION_PER_ACTION; ){
+        int n = std::min(pool.size(), SIMULATION_PER_ACTION - done);
+        for(int k = 0; k < n; k++){
+            NodeId best_child = find_best_ucb(cur_id, tree);
+            update(best_child, virtual_loss_score(best_child, tree), VIRTUAL_LOSS, tree);
+            add(best_child, iter++);
+        }
+        for(NodeId id : batch_id)
+            update(id, -virtual_loss_score(id, tree), -VIRTUAL_LOSS, tree);
+        flush();
+        done += n;
+    }
+}
+
+void mcts_simulate(Position &pos, NodeId cur_id, MCTSTree &tree, const Color root_color, std::mutex *tree_lock, PlayoutPool *pool){
+    if(pool){
+        assert(!tree_lock);
+        mcts_simulate_batched(pos, cur_id, tree, root_color, *pool);
+        return;
+    }
+
+    long long played_moves[total_type][SQUARE_NB][SQUARE_NB] = {{{0}}};// [piece_type][from][to]
+
+    // shared trees are only touched under the lock, the playouts run outside of it
+    auto lock = [&]{ if(tree_lock) tree_lock->lock(); };
+    auto unlock = [&]{ if(tree_lock) tree_lock->unlock(); };
+
+    long long iter = 1;
+    lock();
+    int nchild = tree.Nchild[cur_id];
+    unlock();
+    for(int i = 0; i < nchild; i++){
+        lock();
+        NodeId child_id = tree.child(cur_id, i);
+        Move ply = tree.ply[child_id];
+        int depth = tree.depth[child_id];
+        unlock();
         for(int j = 0; j < INITIAL_SIMULATIONS; j++){
             Position copy(pos);
-            copy.do_move(tree[child_id].ply);
-            int result = pos_simulation(copy, played_moves, root_color, iter, tree[child_id].depth);
-            backpropagate(child_id, result, result * result, 1, tree, played_moves);
+            copy.do_move(ply);
+            int result = pos_simulation(copy, played_moves, root_color, iter, depth);
+            lock();
+            backpropagate(child_id, result, 1, tree, played_moves);
+            unlock();
             iter++;
         }
     }
 
     for(int i = 0; i < SIMULATION_PER_ACTION; i++){
-        int best_child = find_best_ucb(cur_id, tree);
+        lock();
+        NodeId best_child = find_best_ucb(cur_id, tree);
+        Move ply = tree.ply[best_child];
+        int depth = tree.depth[best_child];
+        unlock();
         Position copy(pos);
-        copy.do_move(tree[best_child].ply);
-        int result = pos_simulation(copy, played_moves, root_color, iter, tree[best_child].depth);
-        backpropagate(best_child, result, result * result, 1, tree, played_moves);
+        copy.do_move(ply);
+        int result = pos_simulation(copy, played_moves, root_color, iter, depth);
+        lock();
+        backpropagate(best_child, result, 1, tree, played_moves);
+        unlock();
         iter++;
     }
 }
 
-bool is_move_in_simulation(const MCTSNode &node, const long long played_moves[total_type][SQUARE_NB][SQUARE_NB], const long long iter){
-    int type_index = (node.depth & 1) ? (7 + node.pt_from) : node.pt_from;
-    return played_moves[type_index][node.ply.from()][node.ply.to()] == iter;
+bool is_move_in_simulation(const MCTSTree &tree, NodeId id, const long long played_moves[total_type][SQUARE_NB][SQUARE_NB], const long long iter){
+    int type_index = played_type_index(tree.depth[id], tree.pt_from[id]);
+    return played_moves[type_index][tree.ply[id].from()][tree.ply[id].to()] == iter;
 }
 
-void backpropagate(int id, int deltaS, int deltaS2, const int deltaN, std::vector<MCTSNode> &tree, const long long played_moves[total_type][SQUARE_NB][SQUARE_NB]){
-    int current_id = id;
+void backpropagate(NodeId id, int deltaS, const int deltaN, MCTSTree &tree, const long long played_moves[total_type][SQUARE_NB][SQUARE_NB]){
+    NodeId current_id = id;
     while(true){
         // standard mcts update
-        update(current_id, deltaS, deltaS2, deltaN, tree);
+        update(current_id, deltaS, deltaN, tree);
         if(current_id == root_id)
             break;
 
         // amaf update
-        int parent_id = tree[current_id].p_id;
+        NodeId parent_id = tree.p_id[current_id];
         if(played_moves != nullptr){// not a terminal update
-            for(int i = 0; i < tree[parent_id].Nchild; i++){
-                int sibling_id = tree[parent_id].c_id[i];
+            for(int i = 0; i < tree.Nchild[parent_id]; i++){
+                NodeId sibling_id = tree.child(parent_id, i);
                 if(sibling_id == current_id)
                     continue;
                 
-                if(is_move_in_simulation(tree[sibling_id], played_moves, tree[sibling_id].depth)){
-                    tree[sibling_id].N_AMAF += deltaN;
-                    tree[sibling_id].sum1_AMAF += deltaS;
-                    tree[sibling_id].Mean_AMAF = (long double)tree[sibling_id].sum1_AMAF / tree[sibling_id].N_AMAF;
+                if(is_move_in_simulation(tree, sibling_id, played_moves, tree.depth[sibling_id])){
+                    tree.N_AMAF[sibling_id] += deltaN;
+                    tree.sum1_AMAF[sibling_id] += deltaS;
+                    tree.Mean_AMAF[sibling_id] = (double)tree.sum1_AMAF[sibling_id] / tree.N_AMAF[sibling_id];
                 }
             }
         }
@@ -171,19 +255,19 @@ void backpropagate(int id, int deltaS, int deltaS2, const int deltaN, std::vecto
     }
 }
 
-int find_best_move(const std::vector<MCTSNode> &tree){
-    if(tree[root_id].Nchild == 0) {
+int find_best_move(const MCTSTree &tree){
+    if(tree.Nchild[root_id] == 0) {
         // No children expanded, this should not happen but safety check
         return -1;
     }
     
-    int best_id = tree[root_id].c_id[0];
-    long double bestWR = tree[best_id].Mean; 
+    NodeId best_id = tree.child(root_id, 0);
+    double bestWR = tree.Mean[best_id]; 
     
-    for(int i = 1; i < tree[root_id].Nchild; i++){
-        int ctemp = tree[root_id].c_id[i];
+    for(int i = 1; i < tree.Nchild[root_id]; i++){
+        NodeId ctemp = tree.child(root_id, i);
         
-        long double tempWR = tree[ctemp].Mean; 
+        double tempWR = tree.Mean[ctemp]; 
         
         if(bestWR < tempWR){
             bestWR = tempWR; best_id = ctemp;
@@ -192,18 +276,41 @@ int find_best_move(const std::vector<MCTSNode> &tree){
     return best_id;
 }
 
-void terminal_update(int id, const Position &pos, std::vector<MCTSNode> &tree, const Color root_color){
+void terminal_update(NodeId id, const Position &pos, MCTSTree &tree, const Color root_color){
     int result;
     int diff = pos.count(root_color) - pos.count(Color(root_color ^ 1));
-    if(pos.winner() == root_color){
+    if(pos.game_state() == root_color){
         result = win_score + diff;
     }
-    else if(pos.winner() == Mystery){
+    else if(pos.game_state() == Mystery){
         result = diff;
     }
     else{
         result = -win_score + diff;
     }
-    backpropagate(id, result, result * result, 1, tree, {});
+    backpropagate(id, result, 1, tree, {});
+}
+
+// the grandchild of the root reached by our move (played) and the opponent's reply
+// that gives pos, -1 if either was never expanded
+int find_next_root(const Position &root_pos, Move played, const Position &pos, const MCTSTree &tree){
+    int played_id = -1;
+    for(int i = 0; i < tree.Nchild[root_id]; i++){
+        if(tree.ply[tree.child(root_id, i)] == played)
+            played_id = tree.child(root_id, i);
+    }
+    if(played_id == -1)
+        return -1;
+
+    Position after(root_pos);
+    after.do_move(played);
+    for(int i = 0; i < tree.Nchild[played_id]; i++){
+        NodeId reply = tree.child(played_id, i);
+        Position next(after);
+        next.do_move(tree.ply[reply]);
+        if(next.board_key() == pos.board_key()) // FEN input has no fifty move count
+            return reply;
+    }
+    return -1;
 }
 #endif // MCTS_CPP
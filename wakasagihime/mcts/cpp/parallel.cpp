@@ -0,0 +1,159 @@
+#ifndef PARALLEL_CPP
+#define PARALLEL_CPP
+
+#include "../h/parallel.h"
+#include <thread>
+
+// whether tree is out of budget, playouts are counted as the visits its root got since start_visits
+static bool limit_reached(const SearchLimits &limits, const MCTSTree &tree, int start_visits){
+    if(limits.playouts)
+        return tree.Ntotal[root_id] - start_visits >= limits.playouts;
+    return std::chrono::steady_clock::now() >= limits.deadline;
+}
+
+// selection, expansion, simulation and backpropagation until limits are reached
+// returns the number of iterations done
+int mcts_run(const Position &pos, MCTSTree &tree, const SearchLimits &limits, std::mutex *tree_lock, PlayoutPool *pool){
+    const Color root_color = pos.due_up();
+    int iterations = 0;
+
+    if(!tree_lock){
+        const int start_visits = tree.Ntotal[root_id];
+        while(!limit_reached(limits, tree, start_visits)){
+            NodeId current_id = root_id;
+            Position pv_pos = find_pv(pos, current_id, tree);// current_id is updated inside
+
+            if(!expand(pv_pos, current_id, tree))
+                terminal_update(current_id, pv_pos, tree, root_color);
+            else
+                mcts_simulate(pv_pos, current_id, tree, root_color, nullptr, pool);
+            iterations++;
+        }
+        return iterations;
+    }
+
+    // shared tree: select and expand under the lock, mark the path so that
+    // other threads look elsewhere while we are simulating below it
+    tree_lock->lock();
+    const int start_visits = tree.Ntotal[root_id];
+    tree_lock->unlock();
+    while(true){
+        tree_lock->lock();
+        if(limit_reached(limits, tree, start_visits)){
+            tree_lock->unlock();
+            break;
+        }
+        NodeId current_id = root_id;
+        Position pv_pos = find_pv(pos, current_id, tree);
+        if(!expand(pv_pos, current_id, tree)){
+            terminal_update(current_id, pv_pos, tree, root_color);
+            tree_lock->unlock();
+            iterations++;
+            continue;
+        }
+        add_virtual_loss(current_id, tree);
+        tree_lock->unlock();
+
+        mcts_simulate(pv_pos, current_id, tree, root_color, tree_lock);
+
+        tree_lock->lock();
+        remove_virtual_loss(current_id, tree);
+        tree_lock->unlock();
+        iterations++;
+    }
+    return iterations;
+}
+
+// the root move with the best mean over all trees, Move(0) if none was expanded
+Move merged_best_move(const std::vector<MCTSTree> &trees){
+    std::vector<Move> plies;
+    std::vector<long long> N, sum;
+    for(const MCTSTree &tree : trees){
+        for(int i = 0; i < tree.Nchild[root_id]; i++){
+            NodeId c = tree.child(root_id, i);
+            size_t k = 0;
+            while(k < plies.size() && plies[k] != tree.ply[c])
+                k++;
+            if(k == plies.size()){
+                plies.push_back(tree.ply[c]);
+                N.push_back(0);
+                sum.push_back(0);
+            }
+            N[k] += tree.Ntotal[c];
+            sum[k] += tree.sum1[c];
+        }
+    }
+
+    Move best(0);
+    double bestWR = -inf;
+    for(size_t k = 0; k < plies.size(); k++){
+        double WR = N[k] ? (double)sum[k] / N[k] : 0;
+        if(best == Move(0) || bestWR < WR){
+            bestWR = WR; best = plies[k];
+        }
+    }
+    return best;
+}
+
+// tree sizes and leaf depths of trees, for MoveStats
+// the trees keep the leaf counters themselves, so this costs nothing per node
+static void tree_stats(const std::vector<MCTSTree> &trees, MoveStats &stats){
+    long long total_depth = 0, leaf = 0;
+    for(const MCTSTree &tree : trees){
+        stats.tree_size += tree.size();
+        leaf += tree.leaves;
+        total_depth += tree.leaf_depth_sum;
+        stats.max_depth = std::max(stats.max_depth, tree.max_leaf_depth);
+    }
+    stats.avg_depth = leaf ? (double)total_depth / leaf : 0;
+}
+
+// trees must hold a prepared root for pos: one tree for TREE_PARALLEL and LEAF_PARALLEL,
+// one per thread for ROOT_PARALLEL
+// pool is only used by LEAF_PARALLEL, where it supplies the threads
+// stats, if given, gets the MCTS counters of this search
+Move mcts_search(const Position &pos, std::vector<MCTSTree> &trees, const SearchLimits &limits, int threads, ParallelMode mode, PlayoutPool *pool, MoveStats *stats){
+    std::vector<int> start_visits, iterations(threads, 0);
+    for(const MCTSTree &tree : trees)
+        start_visits.push_back(tree.Ntotal[root_id]);
+
+    if(threads <= 1 || mode == LEAF_PARALLEL){
+        iterations[0] = mcts_run(pos, trees[0], limits, nullptr, mode == LEAF_PARALLEL ? pool : nullptr);
+    }
+    else{
+        // fresh streams for this search, drawn from the caller so that a fixed seed replays them
+        const uint64_t stream = (uint64_t)rng() << 16;
+        std::mutex tree_lock;
+        std::vector<std::thread> workers;
+        for(int i = 0; i < threads; i++){
+            workers.emplace_back([&, i]{
+                seed_rng_stream(stream + i);
+                if(mode == TREE_PARALLEL)
+                    iterations[i] = mcts_run(pos, trees[0], limits, &tree_lock);
+                else
+                    iterations[i] = mcts_run(pos, trees[i], limits);
+            });
+        }
+        for(std::thread &t : workers)
+            t.join();
+    }
+
+    Move best(0);
+    if(trees.size() > 1)
+        best = merged_best_move(trees);
+    else{
+        int best_id = find_best_move(trees[0]);
+        best = (best_id == -1) ? Move(0) : trees[0].ply[best_id];
+    }
+
+    if(stats){
+        for(int n : iterations)
+            stats->iterations += n;
+        for(size_t i = 0; i < trees.size(); i++)
+            stats->playouts += trees[i].Ntotal[root_id] - start_visits[i];
+        tree_stats(trees, *stats);
+    }
+    return best;
+}
+
+#endif // PARALLEL_CPP
@@ -0,0 +1,66 @@
+#ifndef POOL_CPP
+#define POOL_CPP
+
+#include "../h/pool.h"
+
+PlayoutPool::PlayoutPool(int size) : count(std::max(1, size)){
+    for(int i = 1; i < this->size(); i++)
+        threads.emplace_back(&PlayoutPool::worker, this, i);
+}
+
+PlayoutPool::~PlayoutPool(){
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        quit = true;
+    }
+    start_cv.notify_all();
+    for(std::thread &t : threads)
+        t.join();
+}
+
+// takes playouts off the current batch until none is left
+void PlayoutPool::work(){
+    for(size_t i = next++; i < batch->size(); i = next++){
+        Playout &p = (*batch)[i];
+        p.result = pos_simulation(p.pos, p.played, root_color, p.depth);
+    }
+}
+
+void PlayoutPool::worker(int id){
+    seed_rng_stream(id);
+    long long seen = 0;
+    while(true){
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            start_cv.wait(lk, [&]{ return quit || generation != seen; });
+            if(quit)
+                return;
+            seen = generation;
+        }
+        work();
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            running--;
+        }
+        done_cv.notify_one();
+    }
+}
+
+void PlayoutPool::run(std::vector<Playout> &b, Color color){
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        batch = &b;
+        root_color = color;
+        next = 0;
+        running = threads.size();
+        generation++;
+    }
+    start_cv.notify_all();
+    work();
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        done_cv.wait(lk, [&]{ return running == 0; });
+    }
+}
+
+#endif // POOL_CPP
@@ -3,24 +3,15 @@
 
 #include "../h/simulation.h"
 
+// the moved piece can be taken on its new square, cannon jumps included,
+// and the exchange that follows loses material
 bool is_risky_move(const Position &pos, const Move &m){
-    Direction dirs[] = {NORTH, SOUTH, EAST, WEST};
-    Square to = m.to();
-    Piece my_piece = pos.peek_piece_at(m.from());
-    for(Direction dir: dirs){
-        Square adj = Square(to + dir);
-        if(is_okay(adj)){
-            Piece adj_piece = pos.peek_piece_at(adj);
-            if(adj_piece.side != my_piece.side && adj_piece.side != NO_COLOR
-            && adj_piece.type != Cannon && adj_piece.type > my_piece.type){
-                return true;
-            }
-        }
-    }
-    return false;
+    return pos.see(m) < 0;
 }
 
 int move_evaluation(const Position &pos, const Move &m){
+    if(m.type() == Flipping)
+        return flip_score;
     PieceType attacker = pos.peek_piece_at(m.from()).type;
     PieceType target = pos.peek_piece_at(m.to()).type;
 
@@ -33,13 +24,13 @@ Move strategy_weighted_random(const Position &pos, MoveList<> &moves){
         return Move();
     }
     
-    int scores[MaxChild + 1];
+    int scores[MAX_MOVES];
     scores[0] = 0;
     for(int i = 0; i < moves.size(); i++){
         scores[i] = move_evaluation(pos, moves[i]);
     }
 
-    int prefix[MaxChild + 1];
+    int prefix[MAX_MOVES];
     prefix[0] = scores[0];
     int total = scores[0];
     for(int i = 1; i < moves.size(); i++){
@@ -58,35 +49,47 @@ Move strategy_weighted_random(const Position &pos, MoveList<> &moves){
     return moves[index];
 }
 
-int pos_simulation(Position &pos, long long played_moves[total_type][SQUARE_NB][SQUARE_NB], const Color root_color, const long long iter, long long cur_depth){
+// one playout, record(type_index, from, to) is told every move played
+template<typename Record>
+static int simulate(Position &pos, Record record, const Color root_color, long long cur_depth){
     Position copy(pos);
     
-    const int MAX_SIM_MOVES = 200; // Prevent infinite simulation
     int move_count = 0;
 
-    while (copy.winner() == NO_COLOR && move_count < MAX_SIM_MOVES) {
+    while (copy.game_state() == NO_COLOR && move_count < MAX_SIM_MOVES) {
         MoveList<> moves(copy);
         if(moves.size() == 0) break; // No moves available
         
         Move m = strategy_weighted_random(copy, moves);
         cur_depth++;
-        int type_index = (cur_depth & 1) ? (7 + copy.peek_piece_at(m.from()).type) : copy.peek_piece_at(m.from()).type;
-        played_moves[type_index][m.from()][m.to()] = iter;
+        int type_index = played_type_index(cur_depth, copy.peek_piece_at(m.from()).type);
+        record(type_index, m.from(), m.to());
         copy.do_move(m);
         move_count++;
     }
 
     int diff = copy.count(root_color) - copy.count(Color(root_color ^ 1));
 
-    if (copy.winner() == root_color) {
+    if (copy.game_state() == root_color) {
         return win_score + diff;
-    } else if (copy.winner() == Mystery) {
+    } else if (copy.game_state() == Mystery) {
         return diff;
-    } else if (copy.winner() == NO_COLOR) {
+    } else if (copy.game_state() == NO_COLOR) {
         // Simulation timed out, return current score
         return diff;
     }
     return -win_score + diff;
 }
 
+int pos_simulation(Position &pos, long long played_moves[total_type][SQUARE_NB][SQUARE_NB], const Color root_color, const long long iter, long long cur_depth){
+    return simulate(pos, [&](int type_index, Square from, Square to){ played_moves[type_index][from][to] = iter; },
+                    root_color, cur_depth);
+}
+
+int pos_simulation(Position &pos, PlayedList &played, const Color root_color, long long cur_depth){
+    played.n = 0;
+    return simulate(pos, [&](int type_index, Square from, Square to){ played.add(type_index, from, to); },
+                    root_color, cur_depth);
+}
+
 #endif // SIMULATION_CPP
\ No newline at end of file
@@ -2,30 +2,38 @@
 #define MCTS_H
 
 #include <vector>
+#include <mutex>
 #include "node.h"
 #include "simulation.h"
+#include "pool.h"
 
 const int INITIAL_SIMULATIONS = 5;
 const int SIMULATION_PER_ACTION = 25;
-const long double C = 1.4L;
-const int root_id = 0;
+const double C = 1.4;
+const NodeId root_id = 0;
 const int inf = 1e9;
 const int MAX_VISIT = 1e4;
-const long double RANGE = 64.0L;
-const long double MIN_S = -32.0L;
+const double RANGE = 64.0;
+const double MIN_S = -32.0;
 
 const double RAVE_EQUIV = 800.0;
+const int VIRTUAL_LOSS = 1; // visits added along the path a tree-parallel thread is working on
 
-long double UCB(int id, const std::vector<MCTSNode> &tree);
-int find_best_ucb(int cur_id, const std::vector<MCTSNode> &tree);
-Position find_pv(const Position &pos, int &cur_id, const std::vector<MCTSNode> &tree);
-bool expand(const Position &pos, const int cur_id, std::vector<MCTSNode> &tree);
-void update(int id, const int deltaS, const int deltaS2, const int deltaN, std::vector<MCTSNode> &tree);
-void mcts_simulate(Position &pos, int cur_id, std::vector<MCTSNode> &tree, const Color root_color);
-void backpropagate(int id, int deltaS, int deltaS2, const int deltaN, std::vector<MCTSNode> &tree, const long long played_moves[total_type][SQUARE_NB][SQUARE_NB]);
-int find_best_move(const std::vector<MCTSNode> &tree);
-void terminal_update(int id, const Position &pos, std::vector<MCTSNode> &tree, const Color root_color);
-bool is_move_in_simulation(const MCTSNode &node, const long long played_moves[total_type][SQUARE_NB][SQUARE_NB], const long long iter);
+const size_t MCTS_RESERVE_NODES = 1 << 20; // nodes allocated up front, the tree may still grow past it
+
+double UCB(NodeId id, const MCTSTree &tree);
+NodeId find_best_ucb(NodeId cur_id, const MCTSTree &tree);
+Position find_pv(const Position &pos, NodeId &cur_id, const MCTSTree &tree);
+bool expand(const Position &pos, const NodeId cur_id, MCTSTree &tree);
+void update(NodeId id, const int deltaS, const int deltaN, MCTSTree &tree);
+void add_virtual_loss(NodeId leaf, MCTSTree &tree);
+void remove_virtual_loss(NodeId leaf, MCTSTree &tree);
+void mcts_simulate(Position &pos, NodeId cur_id, MCTSTree &tree, const Color root_color, std::mutex *tree_lock = nullptr, PlayoutPool *pool = nullptr);
+void backpropagate(NodeId id, int deltaS, const int deltaN, MCTSTree &tree, const long long played_moves[total_type][SQUARE_NB][SQUARE_NB]);
+int find_best_move(const MCTSTree &tree);
+void terminal_update(NodeId id, const Position &pos, MCTSTree &tree, const Color root_color);
+bool is_move_in_simulation(const MCTSTree &tree, NodeId id, const long long played_moves[total_type][SQUARE_NB][SQUARE_NB], const long long iter);
 bool early_termination(Position &pos);
+int find_next_root(const Position &root_pos, Move played, const Position &pos, const MCTSTree &tree);
 
 #endif // MCTS_H
\ No newline at end of file
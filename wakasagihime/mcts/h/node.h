@@ -2,65 +2,156 @@
 #define NODE_H
 
 #include <vector>
+#include <cstdint>
+#include <algorithm>
 #include "../../lib/chess.h"
-const int MaxChild = 100;
 
-class MCTSNode{
+using NodeId = uint32_t;
+
+// The search tree, stored as a structure of arrays indexed by NodeId.
+// The children of a node are created together by add_children() and sit next to
+// each other: ids first_child[id] ... first_child[id] + Nchild[id] - 1.
+class MCTSTree{
 public:
-    Move ply;  // the ply from parent to here
-    long long p_id; // parent id, root’s parent is the root
-    long long c_id[MaxChild]; // children id
-    int depth; // depth, 0 for the root
-    long long Nchild; // number of children
-    long long Ntotal; // total # of simulations
-    long double CsqrtlogN; // c * sqrt(log(Ntotal))
-    long double sqrtN; // sqrt(Ntotal)
-    long long sum1; // sum1: sum of scores
-    long long sum2; // sum2: sum of square of each score
-    long double Mean; // average score, i.e. win rate
-    long double Variance; // variance of score
-
-    Color c_from;
-    PieceType pt_from;
-
-    int N_AMAF;
-    long long sum1_AMAF;
-    long double Mean_AMAF;
+    std::vector<Move> ply;              // the ply from parent to here
+    std::vector<NodeId> p_id;           // parent id, root's parent is the root
+    std::vector<NodeId> first_child;    // id of the first child
+    std::vector<uint16_t> Nchild;       // number of children
+    std::vector<uint16_t> depth;        // depth, 0 for the root
+    std::vector<PieceType> pt_from;     // type of the piece that played ply
+
+    std::vector<int32_t> Ntotal;        // total # of simulations
+    std::vector<int32_t> sum1;          // sum of scores
+    std::vector<float> Mean;            // average score, i.e. win rate
+    std::vector<float> sqrtN;           // sqrt(Ntotal)
+    std::vector<float> CsqrtlogN;       // c * sqrt(log(Ntotal))
+
+    std::vector<int32_t> N_AMAF;
+    std::vector<int32_t> sum1_AMAF;
+    std::vector<float> Mean_AMAF;
+
+    // kept up to date as nodes are added, for MoveStats
+    NodeId leaves = 0;
+    long long leaf_depth_sum = 0;
+    int max_leaf_depth = 0;
+
+    NodeId size() const { return ply.size(); }
+    NodeId child(NodeId id, int i) const { return first_child[id] + i; }
+
+    void reserve(size_t n){
+        ply.reserve(n); p_id.reserve(n); first_child.reserve(n); Nchild.reserve(n);
+        depth.reserve(n); pt_from.reserve(n);
+        Ntotal.reserve(n); sum1.reserve(n); Mean.reserve(n); sqrtN.reserve(n); CsqrtlogN.reserve(n);
+        N_AMAF.reserve(n); sum1_AMAF.reserve(n); Mean_AMAF.reserve(n);
+    }
+
+    void clear(){
+        ply.clear(); p_id.clear(); first_child.clear(); Nchild.clear();
+        depth.clear(); pt_from.clear();
+        Ntotal.clear(); sum1.clear(); Mean.clear(); sqrtN.clear(); CsqrtlogN.clear();
+        N_AMAF.clear(); sum1_AMAF.clear(); Mean_AMAF.clear();
+        leaves = 0; leaf_depth_sum = 0; max_leaf_depth = 0;
+    }
 
     // root
-    MCTSNode(long long pid = 0, long long d = 0){
-        p_id = pid;
-        depth = d;
-        // expandable = true;
-        Nchild = 0;
-        Ntotal = 0;
-
-        sum1 = 0;
-        sum2 = 0;
-
-        N_AMAF = 0;
-        sum1_AMAF = 0;
-        Mean_AMAF = 0;
+    NodeId add_root(){
+        clear();
+        return add_node(0, 0, Move(0), NO_PIECE);
+    }
+
+    // one child per move, pos is the position at id
+    void add_children(NodeId id, const Move *begin, const Move *end, const Position &pos){
+        if(Nchild[id] == 0 && begin != end){
+            leaves--;
+            leaf_depth_sum -= depth[id];
+        }
+        first_child[id] = size();
+        Nchild[id] = end - begin;
+        for(const Move *m = begin; m != end; m++)
+            add_node(id, depth[id] + 1, *m, pos.peek_piece_at(m->from()).type);
+    }
+
+    // makes new_root the root, keeping only its subtree, in place
+    // the kept nodes keep their order: each one moves down to a slot that was read before,
+    // parents still come before their children and sibling groups stay contiguous
+    void reroot(NodeId new_root){
+        // a node is kept if its parent is, and parents have smaller ids than their children
+        remap.assign(size(), NONE);
+        NodeId n = 0;
+        remap[new_root] = n++;
+        for(NodeId id = new_root + 1; id < size(); id++){
+            if(remap[p_id[id]] != NONE)
+                remap[id] = n++;
+        }
+
+        const int root_depth = depth[new_root];
+        leaves = 0; leaf_depth_sum = 0; max_leaf_depth = 0;
+        for(NodeId id = new_root; id < size(); id++){
+            NodeId to = remap[id];
+            if(to == NONE)
+                continue;
+            ply[to] = ply[id];
+            p_id[to] = (id == new_root) ? 0 : remap[p_id[id]];
+            first_child[to] = Nchild[id] ? remap[first_child[id]] : 0;
+            Nchild[to] = Nchild[id];
+            depth[to] = depth[id] - root_depth;
+            pt_from[to] = pt_from[id];
+            copy_stats(to, *this, id);
+            if(Nchild[to] == 0)
+                count_leaf(depth[to]);
+        }
+        resize(n);
+    }
+
+private:
+    static constexpr NodeId NONE = UINT32_MAX;
+    std::vector<NodeId> remap; // reroot() scratch, old id -> new id, kept for its capacity
+
+    // shrinks without giving memory back
+    void resize(size_t n){
+        ply.resize(n); p_id.resize(n); first_child.resize(n); Nchild.resize(n);
+        depth.resize(n); pt_from.resize(n);
+        Ntotal.resize(n); sum1.resize(n); Mean.resize(n); sqrtN.resize(n); CsqrtlogN.resize(n);
+        N_AMAF.resize(n); sum1_AMAF.resize(n); Mean_AMAF.resize(n);
     }
 
-    // non-root
-    MCTSNode(long long pid, long long d, Move m, const Position &pos){
-        p_id = pid;
-        depth = d;
-        ply = m;
-        Nchild = 0;
-        Ntotal = 0;
+    void copy_stats(NodeId id, const MCTSTree &from, NodeId from_id){
+        Ntotal[id] = from.Ntotal[from_id];
+        sum1[id] = from.sum1[from_id];
+        Mean[id] = from.Mean[from_id];
+        sqrtN[id] = from.sqrtN[from_id];
+        CsqrtlogN[id] = from.CsqrtlogN[from_id];
+        N_AMAF[id] = from.N_AMAF[from_id];
+        sum1_AMAF[id] = from.sum1_AMAF[from_id];
+        Mean_AMAF[id] = from.Mean_AMAF[from_id];
+    }
+
+    void count_leaf(int d){
+        leaves++;
+        leaf_depth_sum += d;
+        max_leaf_depth = std::max(max_leaf_depth, d);
+    }
 
-        sum1 = 0;
-        sum2 = 0;
+    NodeId add_node(NodeId pid, int d, Move m, PieceType pt){
+        count_leaf(d);
+        ply.push_back(m);
+        p_id.push_back(pid);
+        first_child.push_back(0);
+        Nchild.push_back(0);
+        depth.push_back(d);
+        pt_from.push_back(pt);
 
-        c_from = pos.peek_piece_at(m.from()).side;
-        pt_from = pos.peek_piece_at(m.from()).type;
+        Ntotal.push_back(0);
+        sum1.push_back(0);
+        Mean.push_back(0);
+        sqrtN.push_back(0);
+        CsqrtlogN.push_back(0);
 
-        N_AMAF = 0;
-        sum1_AMAF = 0;
-        Mean_AMAF = 0;
+        N_AMAF.push_back(0);
+        sum1_AMAF.push_back(0);
+        Mean_AMAF.push_back(0);
+        return size() - 1;
     }
 };
 
-#endif // NODE_H
\ No newline at end of file
+#endif // NODE_H
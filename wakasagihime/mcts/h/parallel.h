@@ -0,0 +1,29 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include "mcts.h"
+#include "../../utils/h/stats.h"
+
+// ROOT_PARALLEL: every thread grows its own tree, root statistics are merged at the end
+// TREE_PARALLEL: all threads share one tree behind a lock, virtual loss keeps them apart
+// LEAF_PARALLEL: one tree and one searching thread, the playouts of each expansion run on a PlayoutPool
+enum ParallelMode { ROOT_PARALLEL, TREE_PARALLEL, LEAF_PARALLEL };
+
+using Deadline = std::chrono::steady_clock::time_point;
+
+// when to stop searching: at the deadline, or after a fixed number of playouts per tree
+// a playout budget makes the search independent of the clock, so that a seeded run
+// can be replayed exactly
+struct SearchLimits {
+    Deadline deadline = Deadline::max();
+    int playouts = 0; // 0: no budget, use the deadline
+};
+
+int mcts_run(const Position &pos, MCTSTree &tree, const SearchLimits &limits, std::mutex *tree_lock = nullptr, PlayoutPool *pool = nullptr);
+Move mcts_search(const Position &pos, std::vector<MCTSTree> &trees, const SearchLimits &limits, int threads, ParallelMode mode, PlayoutPool *pool = nullptr, MoveStats *stats = nullptr);
+Move merged_best_move(const std::vector<MCTSTree> &trees);
+
+#endif // PARALLEL_H
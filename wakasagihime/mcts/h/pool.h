@@ -0,0 +1,52 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include "simulation.h"
+
+// one playout: its input and its result
+struct Playout {
+    Position pos;       // the position after the move being simulated
+    long long iter;     // stamp to write into played_moves
+    long long depth;    // tree depth of pos
+    int result = 0;
+    PlayedList played;  // AMAF entries touched, stamp them with iter before backpropagating
+};
+
+// Fixed set of threads running batches of playouts (leaf parallelization).
+// The calling thread works on the batch as well, so a pool of size n starts n - 1 threads.
+// Every thread has its own rng stream, thread id being the stream id.
+class PlayoutPool {
+public:
+    explicit PlayoutPool(int size);
+    ~PlayoutPool();
+
+    int size() const { return count; }
+
+    // runs every playout of batch, each one recording its own AMAF entries
+    void run(std::vector<Playout> &batch, Color root_color);
+
+private:
+    void worker(int id);
+    void work();
+
+    int count;
+    std::vector<std::thread> threads;
+
+    std::mutex mtx;
+    std::condition_variable start_cv, done_cv;
+    long long generation = 0; // bumped for each batch
+    int running = 0;          // helpers still working on the current batch
+    bool quit = false;
+
+    std::vector<Playout> *batch = nullptr;
+    Color root_color = NO_COLOR;
+    std::atomic<size_t> next{0};
+};
+
+#endif // POOL_H
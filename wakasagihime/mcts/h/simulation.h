@@ -37,10 +37,34 @@ const int yummy_table[7][8] = {
 
 const int win_score = 16;
 
-const int total_type = 14; // 0~6 even depth, 7~13 odd depth
+const int flip_score = 10; // weight of a flip in the playout policy, about a walk
+
+// played_moves rows: the piece types General ~ Hidden (Hidden for flips), once per depth parity
+const int played_type_nb = Hidden + 1;
+const int total_type = 2 * played_type_nb; // 0~8 even depth, 9~17 odd depth
+
+inline int played_type_index(long long depth, PieceType pt){
+    return (depth & 1) ? (played_type_nb + pt) : pt;
+}
+
+const int MAX_SIM_MOVES = 200; // Prevent infinite simulation
+
+// the AMAF entries of played_moves one playout touched, for playouts run away from the tree
+struct PlayedList {
+    int n = 0;
+    uint16_t entry[MAX_SIM_MOVES]; // type_index << 10 | from << 5 | to
+
+    void add(int type_index, int from, int to){ entry[n++] = type_index << 10 | from << 5 | to; }
+    // stamps the entries into played_moves as pos_simulation() would have
+    void apply(long long played_moves[total_type][SQUARE_NB][SQUARE_NB], long long iter) const{
+        for(int i = 0; i < n; i++)
+            played_moves[entry[i] >> 10][(entry[i] >> 5) & 31][entry[i] & 31] = iter;
+    }
+};
 
 int move_evaluation(const Position &pos, const Move &m);
 Move strategy_weighted_random(const Position &pos, MoveList<> &moves);
 int pos_simulation(Position &pos, long long played_moves[total_type][SQUARE_NB][SQUARE_NB], const Color root_color, const long long iter, long long cur_depth);
+int pos_simulation(Position &pos, PlayedList &played, const Color root_color, long long cur_depth);
 
 #endif // SIMULATION_H
\ No newline at end of file
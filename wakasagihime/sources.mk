@@ -8,6 +8,28 @@ CHINESE = 1
 # +-- Add your own sources here, if any --+
 ADD_SOURCES = mcts/cpp/mcts.cpp \
 			  mcts/cpp/simulation.cpp \
+			  mcts/cpp/parallel.cpp \
+			  mcts/cpp/pool.cpp \
 			  alphabeta/cpp/alphabeta.cpp \
+			  alphabeta/cpp/tt.cpp \
 			  utils/cpp/zobrist.cpp \
-			  utils/cpp/eval.cpp
\ No newline at end of file
+			  utils/cpp/init.cpp \
+			  utils/cpp/stats.cpp \
+			  utils/cpp/eval.cpp
+
+# +-- Benchmarks and checks, built from the engine sources without main --+
+# this file is included first, keep the engine as the default target
+.DEFAULT_GOAL := all
+.PHONY: perft playout mate
+
+# move generation benchmark and make/unmake checks: bench/perft [depth] [fen...]
+perft:
+	g++ -o bench/perft $(CXXFLAGS) -O2 -DCHINESE_ENABLED=$(CHINESE) -march=native $(filter-out wakasagihime.cpp,$(SOURCES)) bench/perft.cpp $(LDFLAGS)
+
+# playout throughput benchmark, prints JSON: bench/playout [samples]
+playout:
+	g++ -o bench/playout $(CXXFLAGS) -O2 -DCHINESE_ENABLED=$(CHINESE) -march=native $(filter-out wakasagihime.cpp,$(SOURCES)) bench/playout.cpp $(LDFLAGS)
+
+# forced wins keep their score through a warm transposition table: bench/mate [fen...]
+mate:
+	g++ -o bench/mate $(CXXFLAGS) -O2 -DCHINESE_ENABLED=$(CHINESE) -march=native $(filter-out wakasagihime.cpp,$(SOURCES)) bench/mate.cpp $(LDFLAGS)
@@ -0,0 +1,34 @@
+#ifndef INIT_CPP
+#define INIT_CPP
+
+#include "../h/init.h"
+#include "../h/zobrist.h"
+#include "../../lib/chess.h"
+#include "../../lib/marisa.h"
+
+void init_tables()
+{
+    // Prepare the distance table
+    for (Square i = SQ_A1; i < SQUARE_NB; i += 1) {
+        for (Square j = SQ_A1; j < SQUARE_NB; j += 1) {
+            SquareDistance[i][j] = distance<Rank>(i, j) + distance<File>(i, j);
+        }
+    }
+
+    // Prepare the attack table (regular)
+    Direction dirs[4] = { NORTH, SOUTH, EAST, WEST };
+    for (Square sq = SQ_A1; is_okay(sq); sq += 1) {
+        Board a = 0;
+        for (Direction d : dirs) {
+            a |= safe_destination(sq, d);
+        }
+        PseudoAttacks[sq] = a;
+    }
+
+    // Prepare magic
+    init_magic<Cannon>(cannonTable, cannonMagics);
+
+    init_zobrist();
+}
+
+#endif // INIT_CPP
@@ -0,0 +1,96 @@
+#ifndef STATS_CPP
+#define STATS_CPP
+
+#include "../h/stats.h"
+#include <iostream>
+#include <sstream>
+
+static std::string to_json(const MoveStats &s){
+    std::ostringstream os;
+    os << "{\"round\":" << s.round
+       << ",\"move\":" << s.move
+       << ",\"engine\":\"" << (s.alphabeta ? "alphabeta" : "mcts") << "\"";
+    if(s.best != Move(0)){
+        os << ",\"best\":\"" << s.best.from();
+        if(s.best.type() != Flipping)
+            os << " " << s.best.to();
+        os << "\"";
+    }
+    os << ",\"total_ms\":" << s.total_ms
+       << ",\"setup_ms\":" << s.setup_ms
+       << ",\"search_ms\":" << s.search_ms;
+
+    double seconds = s.search_ms / 1000;
+    if(s.alphabeta){
+        os << ",\"nodes\":" << s.nodes
+           << ",\"nodes_per_sec\":" << (seconds > 0 ? (uint64_t)(s.nodes / seconds) : 0)
+           << ",\"depth\":" << s.ab_depth
+           << ",\"tt_probes\":" << s.tt_probes
+           << ",\"tt_hits\":" << s.tt_hits
+           << ",\"tt_hit_rate\":" << (s.tt_probes ? (double)s.tt_hits / s.tt_probes : 0);
+    }
+    else{
+        os << ",\"iterations\":" << s.iterations
+           << ",\"playouts\":" << s.playouts
+           << ",\"playouts_per_sec\":" << (seconds > 0 ? (long long)(s.playouts / seconds) : 0)
+           << ",\"tree_size\":" << s.tree_size
+           << ",\"max_depth\":" << s.max_depth
+           << ",\"avg_depth\":" << s.avg_depth;
+    }
+    os << "}\n";
+    return os.str();
+}
+
+bool StatsWriter::open(const std::string &path){
+    if(enabled())
+        return false;
+    if(path == "-")
+        out = &std::cerr;
+    else{
+        file.open(path, std::ios::app);
+        if(!file.is_open())
+            return false;
+        out = &file;
+    }
+    thread = std::thread(&StatsWriter::run, this);
+    return true;
+}
+
+void StatsWriter::write(const MoveStats &s){
+    if(!enabled())
+        return;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        queue.push_back(s);
+    }
+    cv.notify_one();
+}
+
+void StatsWriter::run(){
+    std::unique_lock<std::mutex> lk(mtx);
+    while(true){
+        cv.wait(lk, [&]{ return quit || !queue.empty(); });
+        while(!queue.empty()){
+            MoveStats s = queue.front();
+            queue.pop_front();
+            lk.unlock();
+            *out << to_json(s) << std::flush;
+            lk.lock();
+        }
+        if(quit)
+            return;
+    }
+}
+
+StatsWriter::~StatsWriter(){
+    if(!thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        quit = true;
+    }
+    cv.notify_one();
+    thread.join();
+}
+
+#endif // STATS_CPP
@@ -3,27 +3,34 @@
 
 #include "../h/zobrist.h"
 
-uint64_t zob[SIDE_NB][PIECE_TYPE_NB][SQUARE_NB];
 pcg64 rng64;
 
 void init_zobrist(){
     rng64.seed(42); // std::random_device{}()
-    for(int color = 0; color < SIDE_NB; ++color){
+    for(int color = 0; color < NO_COLOR; ++color){
         for(int pieceType = 0; pieceType < PIECE_TYPE_NB; ++pieceType){
             for(int square = 0; square < SQUARE_NB; ++square){
-                zob[color][pieceType][square] = rng64();
+                Zobrist::psq[color][pieceType][square] = rng64();
             }
         }
     }
+    Zobrist::side = rng64();
+    Zobrist::fifty[0] = 0; // a fresh position hashes the same as before any move
+    for(int n = 1; n < FIFTY_MOVE_NB; ++n){
+        Zobrist::fifty[n] = rng64();
+    }
 }
 
 uint64_t compute_zobrist_hash(const Position &pos){
     uint64_t hash = 0;
     for(Square sq: BoardView(pos.pieces())){
         Piece p = pos.peek_piece_at(sq);
-        hash ^= zob[p.side][p.type][sq];
+        hash ^= Zobrist::psq[p.side][p.type][sq];
     }
+    if(pos.due_up() == Black)
+        hash ^= Zobrist::side;
+    hash ^= Zobrist::fifty[std::min(pos.fifty_moves(), FIFTY_MOVE_NB - 1)];
     return hash;
 }
 
-#endif // ZOBRIST_CPP
\ No newline at end of file
+#endif // ZOBRIST_CPP
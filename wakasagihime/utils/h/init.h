@@ -0,0 +1,8 @@
+#ifndef INIT_H
+#define INIT_H
+
+// fills the distance, attack, magic and zobrist tables
+// every program must call it once before touching a Position
+void init_tables();
+
+#endif // INIT_H
@@ -0,0 +1,66 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "../../lib/chess.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// what happened while choosing one move
+// the searches fill in their own part, the rest stays 0
+struct MoveStats {
+    int round = 0;            // game number
+    int move = 0;             // our move number in this game
+    bool alphabeta = false;   // which engine chose the move
+    Move best = Move(0);
+
+    double total_ms = 0;      // from reading the position to answering
+    double setup_ms = 0;      // building / rerooting the trees
+    double search_ms = 0;
+
+    // MCTS
+    long long iterations = 0; // selections, over all threads
+    long long playouts = 0;   // new root visits, over all trees
+    size_t tree_size = 0;     // nodes, over all trees
+    int max_depth = 0;        // of the leaves
+    double avg_depth = 0;
+
+    // alpha-beta
+    uint64_t nodes = 0;       // over all threads
+    int ab_depth = 0;         // deepest finished iteration
+    uint64_t tt_probes = 0;
+    uint64_t tt_hits = 0;
+};
+
+// Writes one JSON line per MoveStats on a background thread, so that
+// formatting and I/O never delay the answer.
+class StatsWriter {
+public:
+    StatsWriter() = default;
+    ~StatsWriter();
+
+    // "-" writes to stderr, anything else is a file to append to
+    // returns false if the file can't be opened
+    bool open(const std::string &path);
+    bool enabled() const { return out != nullptr; }
+
+    // queues s, nothing happens unless open() succeeded
+    void write(const MoveStats &s);
+
+private:
+    void run();
+
+    std::ostream *out = nullptr;
+    std::ofstream file;
+    std::thread thread;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<MoveStats> queue;
+    bool quit = false;
+};
+
+#endif // STATS_H
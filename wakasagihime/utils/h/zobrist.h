@@ -5,6 +5,7 @@
 #include "../../lib/pcg-cpp-0.98/include/pcg_random.hpp"
 
 void init_zobrist();
+// full recomputation, Position::key() keeps the same value incrementally
 uint64_t compute_zobrist_hash(const Position &pos);
 
-#endif // ZOBRIST_H
\ No newline at end of file
+#endif // ZOBRIST_H
@@ -8,89 +8,84 @@
 #include <cmath>
 #include <chrono>
 #include "mcts/h/mcts.h"
+#include "mcts/h/parallel.h"
 #include <fstream>
 #include "alphabeta/h/alphabeta.h"
 #include "utils/h/eval.h"
 #include "utils/h/zobrist.h"
+#include "utils/h/init.h"
+#include "utils/h/stats.h"
 #include <unordered_map>
+#include <cstring>
 
 // Girls are preparing...
 __attribute__((constructor)) void prepare()
 {
-    // Prepare the distance table
-    for (Square i = SQ_A1; i < SQUARE_NB; i += 1) {
-        for (Square j = SQ_A1; j < SQUARE_NB; j += 1) {
-            SquareDistance[i][j] = distance<Rank>(i, j) + distance<File>(i, j);
-        }
-    }
-
-    // Prepare the attack table (regular)
-    Direction dirs[4] = { NORTH, SOUTH, EAST, WEST };
-    for (Square sq = SQ_A1; is_okay(sq); sq += 1) {
-        Board a = 0;
-        for (Direction d : dirs) {
-            a |= safe_destination(sq, d);
-        }
-        PseudoAttacks[sq] = a;
-    }
-
-    // Prepare magic
-    init_magic<Cannon>(cannonTable, cannonMagics);
-
-    init_zobrist();
+    init_tables();
 }
 
-void log_position(int best, const std::vector<MCTSNode>& nodes) {
-    std::ofstream fout("./log.log", std::ios::app); // append mode
-    if (!fout.is_open()) {
-        std::cerr << "Failed to open log file\n";
-        return;
-    }
-
-
-    fout << "Total simulations: " << nodes[0].Ntotal << "\n";
-    fout << "Best simulations mean: " << nodes[best].Mean << "\n";
-    fout << "------------------------\n";
-
-    fout.close();
-}
-
-void show_tree(const std::vector<MCTSNode>& nodes) {
-    int max_depth = 0;
-    long int total_depth = 0;
-    int leaf = 0;
-    for (size_t i = 0; i < nodes.size(); ++i) {
-        if(nodes[i].Nchild == 0) {
-            ++leaf;
-            total_depth += nodes[i].depth;
-            if (nodes[i].depth > max_depth) {
-                max_depth = nodes[i].depth;
+// le fishe
+// usage: wakasagi [--threads N] [--hash MB] [--parallel root|tree|leaf] [--seed S] [--playouts N] [--nodes N] [--stats FILE]
+// --playouts and --nodes replace the clock by a fixed budget per move for MCTS and alpha-beta,
+// together with --seed the answers are then the same on every run (with one thread, or root parallel MCTS),
+// alpha-beta always searches with a single thread once --nodes or --seed is given
+// --hash sets the size of the alpha-beta transposition table in MB, rounded down to a power of two
+// --stats appends one JSON line of search statistics per move to FILE, "-" for stderr
+int main(int argc, char *argv[])
+{
+    int threads = 1;
+    ParallelMode mode = ROOT_PARALLEL;
+    SearchLimits limits;
+    uint64_t ab_nodes = 0;
+    size_t hash_mb = AB_TT_SIZE_MB;
+    bool seeded = false;
+    StatsWriter stats_writer;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--hash") && i + 1 < argc) {
+            hash_mb = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--parallel") && i + 1 < argc) {
+            ++i;
+            mode = !strcmp(argv[i], "tree") ? TREE_PARALLEL
+                 : !strcmp(argv[i], "leaf") ? LEAF_PARALLEL : ROOT_PARALLEL;
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed_rng(strtoull(argv[++i], nullptr, 10));
+            seeded = true;
+        } else if (!strcmp(argv[i], "--playouts") && i + 1 < argc) {
+            limits.playouts = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--nodes") && i + 1 < argc) {
+            ab_nodes = std::max(1ULL, strtoull(argv[++i], nullptr, 10));
+        } else if (!strcmp(argv[i], "--stats") && i + 1 < argc) {
+            if (!stats_writer.open(argv[++i])) {
+                error << "Can't open " << argv[i] << "\n";
+                return 1;
             }
+        } else {
+            error << "Unknown option " << argv[i] << "\n";
+            return 1;
         }
     }
-    std::ofstream fout("./log.log", std::ios::app); // append mode
-    if (!fout.is_open()) {
-        std::cerr << "Failed to open log file\n";
-        return;
-    }
-
-
-    fout << "Max depth: " << max_depth << "\n";
-    fout << "Average depth: " << (leaf > 0 ? static_cast<double>(total_depth) / leaf : 0) << "\n";
-    fout << "Leaf nodes: " << leaf << "\n";
-    fout << "------------------------\n";
 
-    fout.close();
-}
-
-// le fishe
-int main()
-{
+    // Lazy SMP threads race on the shared TT, only one thread searches the same tree every run
+    const int ab_threads = (ab_nodes || seeded) ? 1 : threads;
     std::string line;
     std::chrono::milliseconds TIME_LIMIT(4500);
     std::unordered_map<uint64_t, std::pair<int, Move>> tt; // transposition table: board hash -> (game round, Move)
+    TT.resize(hash_mb); // search transposition table for F3
+    // one tree per thread for root parallelization, a single shared one otherwise
+    std::vector<MCTSTree> trees(mode == ROOT_PARALLEL ? threads : 1);
+    for (MCTSTree &tree : trees)
+        tree.reserve(MCTS_RESERVE_NODES);
+    PlayoutPool pool(mode == LEAF_PARALLEL ? threads : 1);
+    Position last_root;        // the position the trees were searched from
+    Move last_played = Move(0); // the move we played, Move(0) if the trees can't be reused
 
     int game_round = 0;
+    int move_number = 0;
+    auto ms_since = [](std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+    };
     /* read input board state */
     while (std::getline(std::cin, line)) {
         auto start_time = std::chrono::steady_clock::now();
@@ -98,7 +93,14 @@ int main()
 
         if(is_new_game(pos)){
             game_round++;
+            move_number = 0;
+            last_played = Move(0);
         }
+        move_number++;
+        MoveStats stats;
+        stats.round = game_round;
+        stats.move = move_number;
+        MoveStats *stats_ptr = stats_writer.enabled() ? &stats : nullptr;
 
         // Get available moves as fallback
         MoveList<> moves(pos);
@@ -111,9 +113,11 @@ int main()
         // check whether is close to terminal
         if(early_termination(pos)){
             // switch to alpha-beta
-            Move ab_move = alphabeta_search(pos, tt, game_round);
+            auto search_start = std::chrono::steady_clock::now();
+            Move ab_move = alphabeta_search(pos, tt, game_round, ab_threads, ab_nodes, stats_ptr);
+            stats.search_ms = ms_since(search_start);
 
-            uint64_t pos_hash = compute_zobrist_hash(pos);
+            uint64_t pos_hash = pos.key();
             if(tt.find(pos_hash) == tt.end()){
                 tt[pos_hash] = std::make_pair(game_round, ab_move);
             }
@@ -121,45 +125,44 @@ int main()
                 tt[pos_hash] = std::make_pair(game_round, ab_move);
             }
             info << ab_move;
+            last_played = Move(0);
+
+            stats.alphabeta = true;
+            stats.best = ab_move;
+            stats.total_ms = ms_since(start_time);
+            stats_writer.write(stats);
             continue;
         }
 
         
-        // build root node
-        std::vector<MCTSNode> tree;
-        tree.push_back(MCTSNode(0, 0)); // root
-
-        // MCTS main loop
-        int iterations = 0;
-        while (std::chrono::steady_clock::now() - start_time < TIME_LIMIT){
-            // Selection
-            int current_id = root_id;
-            Color root_color = pos.due_up();
-            Position pv_pos = find_pv(pos, current_id, tree);// current_id is updated inside
-
-            // Expansion
-            if(!expand(pv_pos, current_id, tree)){
-                // a terminal node is reached
-                terminal_update(current_id, pv_pos, tree, root_color);
-            }
-            else{
-                // Simulation & Backpropagation
-                mcts_simulate(pv_pos, current_id, tree, root_color);
-            }
-            iterations++;
+        // build root nodes, keeping the subtree the game went into
+        for (MCTSTree &tree : trees) {
+            int next_root = (last_played == Move(0)) ? -1 : find_next_root(last_root, last_played, pos, tree);
+            if(next_root == -1)
+                tree.add_root();
+            else
+                tree.reroot(next_root);
         }
 
-        // choose the best move
-        int best_id = find_best_move(tree);
-        if(best_id == -1) {
+        stats.setup_ms = ms_since(start_time);
+
+        // MCTS main loop, then choose the best move
+        if (!limits.playouts)
+            limits.deadline = start_time + TIME_LIMIT;
+        auto search_start = std::chrono::steady_clock::now();
+        Move best = mcts_search(pos, trees, limits, threads, mode, &pool, stats_ptr);
+        stats.search_ms = ms_since(search_start);
+        if(best == Move(0)) {
             // Fallback: output first available move
             info << moves[0];
         } else {
-            info << tree[best_id].ply;
+            info << best;
         }
-        /*
-        log_position(best_id, tree);
-        show_tree(tree);
-        */
+        last_root = pos;
+        last_played = best;
+
+        stats.best = best;
+        stats.total_ms = ms_since(start_time);
+        stats_writer.write(stats);
     }
 }